@@ -1,2 +1,5 @@
-g++ -std=c++17 main.cpp gfx\*.c gfx\*.h -I.\SDL2\x86_64-w64-mingw32\include -L.\SDL2\x86_64-w64-mingw32\lib -Wall -lmingw32 -lSDL2main -lSDL2 -I.\gfx -o maincc
+g++ -std=c++17 -c pointmarching.cpp -Wall -o pointmarching.o
+ar rcs libpointmarching.a pointmarching.o
+g++ -std=c++17 main.cpp gfx\*.c gfx\*.h -I.\SDL2\x86_64-w64-mingw32\include -L.\SDL2\x86_64-w64-mingw32\lib -L. -Wall -lpointmarching -lmingw32 -lSDL2main -lSDL2 -I.\gfx -o maincc
+g++ -std=c++17 headless.cpp -L. -Wall -lpointmarching -o headless
 .\maincc.exe
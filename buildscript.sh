@@ -1,3 +1,6 @@
 #!/bin/bash
-g++ main.cpp gfx/*.c gfx/*.h -lSDL2 -w -I./gfx -o maincc
+g++ -c pointmarching.cpp -pthread -w -o pointmarching.o
+ar rcs libpointmarching.a pointmarching.o
+g++ main.cpp gfx/*.c gfx/*.h -L. -lpointmarching -lSDL2 -pthread -w -I./gfx -o maincc
+g++ headless.cpp -L. -lpointmarching -pthread -w -o headless
 ./maincc
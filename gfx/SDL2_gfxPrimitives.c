@@ -59,11 +59,298 @@ typedef struct {
 	Sint16 last1x, last1y, last2x, last2y, first1x, first1y, first2x, first2y, tempx, tempy;
 } SDL2_gfxMurphyIterator;
 
+/* ---- Span batch */
+
+/*!
+\brief Storage class of the span batch state.
+
+Every thread has its own batch, so threads filling polygons with their own scratch
+buffers in filledPolygonRGBAMT never share spans, counts or nesting depth.
+*/
+#if defined(__cplusplus) && (__cplusplus >= 201103L)
+#define GFX_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define GFX_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define GFX_THREAD_LOCAL __declspec(thread)
+#else
+#define GFX_THREAD_LOCAL __thread
+#endif
+
+/*!
+\brief Span buffer of the calling thread's batch.
+
+Spans are collected while a batch is open and submitted with one SDL_RenderFillRects
+call when the batch is flushed, instead of one SDL_RenderDrawLine call per span.
+*/
+static GFX_THREAD_LOCAL void *gfxPrimitivesSpans = NULL;
+
+/*!
+\brief Number of rects allocated in the span buffer.
+*/
+static GFX_THREAD_LOCAL int gfxPrimitivesSpansAllocated = 0;
+
+/*!
+\brief Number of spans waiting in the span buffer.
+*/
+static GFX_THREAD_LOCAL int gfxPrimitivesSpanCount = 0;
+
+/*!
+\brief Point buffer of the calling thread's batch, submitted with one SDL_RenderDrawPoints call.
+*/
+static GFX_THREAD_LOCAL void *gfxPrimitivesPoints = NULL;
+
+/*!
+\brief Number of points allocated in the point buffer.
+*/
+static GFX_THREAD_LOCAL int gfxPrimitivesPointsAllocated = 0;
+
+/*!
+\brief Number of points waiting in the point buffer.
+*/
+static GFX_THREAD_LOCAL int gfxPrimitivesPointCount = 0;
+
+/*!
+\brief Nesting depth of the open span batches; spans are only collected when it is above zero.
+*/
+static GFX_THREAD_LOCAL int gfxPrimitivesSpanDepth = 0;
+
+/*!
+\brief Renderer the pending spans belong to.
+*/
+static GFX_THREAD_LOCAL SDL_Renderer *gfxPrimitivesSpanRenderer = NULL;
+
+/*!
+\brief Submit the pending spans and points of a renderer in its currently set color.
+
+\param renderer The renderer to flush.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+int gfxPrimitivesFlushSpans(SDL_Renderer * renderer)
+{
+	int result = 0;
+
+	if (renderer != gfxPrimitivesSpanRenderer) {
+		return 0;
+	}
+
+	if (gfxPrimitivesSpanCount > 0) {
+		result |= SDL_RenderFillRects(renderer, (SDL_Rect *)gfxPrimitivesSpans, gfxPrimitivesSpanCount);
+		gfxPrimitivesSpanCount = 0;
+	}
+	if (gfxPrimitivesPointCount > 0) {
+		result |= SDL_RenderDrawPoints(renderer, (SDL_Point *)gfxPrimitivesPoints, gfxPrimitivesPointCount);
+		gfxPrimitivesPointCount = 0;
+	}
+
+	return result;
+}
+
+/*!
+\brief Open a span batch on a renderer.
+
+Until the matching gfxPrimitivesEndSpans call, the spans of hline, vline and the fill
+primitives and the points of pixel and the outline primitives are collected and
+submitted together. Color and blend mode changes made by
+the primitives flush the batch first, so one batch can cover a whole frame and is drawn
+with one call per run of equally colored primitives. Batches nest; the renderer must
+not be drawn on or have its draw state changed directly while one is open.
+
+Threading: the batch belongs to the calling thread. Primitives only join a batch opened
+by the same thread, on other threads they draw directly or into their own batch, and
+gfxPrimitivesEndSpans must be called on the thread that opened it. A thread's buffers are
+kept for its next batch. Since SDL renderers may only be used from the thread that
+created them, batching on one renderer from several threads is not supported.
+
+\param renderer The renderer to batch on.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+int gfxPrimitivesBeginSpans(SDL_Renderer * renderer)
+{
+	int result = 0;
+
+	if ((gfxPrimitivesSpanDepth > 0) && (renderer != gfxPrimitivesSpanRenderer)) {
+		result |= gfxPrimitivesFlushSpans(gfxPrimitivesSpanRenderer);
+	}
+	gfxPrimitivesSpanRenderer = renderer;
+	gfxPrimitivesSpanDepth++;
+
+	return result;
+}
+
+/*!
+\brief Close a span batch, submitting the pending spans and points when the outermost batch ends.
+
+\param renderer The renderer passed to gfxPrimitivesBeginSpans.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+int gfxPrimitivesEndSpans(SDL_Renderer * renderer)
+{
+	int result = 0;
+
+	if (gfxPrimitivesSpanDepth <= 0) {
+		return (-1);
+	}
+
+	gfxPrimitivesSpanDepth--;
+	if (gfxPrimitivesSpanDepth == 0) {
+		result |= gfxPrimitivesFlushSpans(renderer);
+		gfxPrimitivesSpanRenderer = NULL;
+	}
+
+	return result;
+}
+
+/*!
+\brief Internal function to make room for one more element in a batch buffer.
+
+When the buffer cannot grow, the pending batch is submitted to free it instead.
+
+\param renderer The renderer of the batch.
+\param buffer Pointer to the buffer.
+\param allocated Pointer to the number of elements allocated in the buffer.
+\param count Pointer to the number of elements waiting in the buffer.
+\param size Size of one element.
+
+\returns Returns 1 if there is room, 0 if the element has to be drawn directly, -1 on failure.
+*/
+static int _gfxGrowBatch(SDL_Renderer * renderer, void **buffer, int *allocated, int *count, size_t size)
+{
+	void *grown;
+	int n;
+
+	if (*count < *allocated) {
+		return 1;
+	}
+
+	n = (*allocated) ? 2 * (*allocated) : 256;
+	grown = realloc(*buffer, size * n);
+	if (grown != NULL) {
+		*buffer = grown;
+		*allocated = n;
+		return 1;
+	}
+
+	if (gfxPrimitivesFlushSpans(renderer)) {
+		return (-1);
+	}
+	return (*count < *allocated) ? 1 : 0;
+}
+
+/*!
+\brief Internal function to fill a rect in the currently set color, through the span batch if one is open.
+
+\param renderer The renderer to draw on.
+\param x X coordinate of the left edge of the rect.
+\param y Y coordinate of the top edge of the rect.
+\param w Width of the rect.
+\param h Height of the rect.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+static int _gfxAddSpan(SDL_Renderer * renderer, int x, int y, int w, int h)
+{
+	int room = 0;
+	SDL_Rect *span;
+	SDL_Rect rect;
+
+	if ((gfxPrimitivesSpanDepth > 0) && (renderer == gfxPrimitivesSpanRenderer)) {
+		room = _gfxGrowBatch(renderer, &gfxPrimitivesSpans, &gfxPrimitivesSpansAllocated, &gfxPrimitivesSpanCount, sizeof(SDL_Rect));
+		if (room < 0) {
+			return (-1);
+		}
+	}
+
+	if (!room) {
+		rect.x = x;
+		rect.y = y;
+		rect.w = w;
+		rect.h = h;
+		return SDL_RenderFillRect(renderer, &rect);
+	}
+
+	span = (SDL_Rect *)gfxPrimitivesSpans + gfxPrimitivesSpanCount++;
+	span->x = x;
+	span->y = y;
+	span->w = w;
+	span->h = h;
+
+	return 0;
+}
+
+/*!
+\brief Internal function to draw a point in the currently set color, through the span batch if one is open.
+
+\param renderer The renderer to draw on.
+\param x X coordinate of the point.
+\param y Y coordinate of the point.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+static int _gfxAddPoint(SDL_Renderer * renderer, int x, int y)
+{
+	int room = 0;
+	SDL_Point *point;
+
+	if ((gfxPrimitivesSpanDepth > 0) && (renderer == gfxPrimitivesSpanRenderer)) {
+		room = _gfxGrowBatch(renderer, &gfxPrimitivesPoints, &gfxPrimitivesPointsAllocated, &gfxPrimitivesPointCount, sizeof(SDL_Point));
+		if (room < 0) {
+			return (-1);
+		}
+	}
+
+	if (!room) {
+		return SDL_RenderDrawPoint(renderer, x, y);
+	}
+
+	point = (SDL_Point *)gfxPrimitivesPoints + gfxPrimitivesPointCount++;
+	point->x = x;
+	point->y = y;
+
+	return 0;
+}
+
+/*!
+\brief Internal function to set the draw color and blend mode, skipping the calls when they are already set.
+
+Pending spans are flushed before the state changes, so they are drawn in the state they were added in.
+
+\param renderer The renderer to draw on.
+\param r The red value to set.
+\param g The green value to set.
+\param b The blue value to set.
+\param a The alpha value to set; blending is enabled if a<255.
+
+\returns Returns 0 on success, -1 on failure.
+*/
+static int _gfxSetRenderDrawState(SDL_Renderer * renderer, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+{
+	int result = 0;
+	SDL_BlendMode mode = (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND;
+	SDL_BlendMode currentMode;
+	Uint8 cr, cg, cb, ca;
+
+	if ((SDL_GetRenderDrawBlendMode(renderer, &currentMode) == 0) && (SDL_GetRenderDrawColor(renderer, &cr, &cg, &cb, &ca) == 0) &&
+		(currentMode == mode) && (cr == r) && (cg == g) && (cb == b) && (ca == a)) {
+		return 0;
+	}
+
+	result |= gfxPrimitivesFlushSpans(renderer);
+	result |= SDL_SetRenderDrawBlendMode(renderer, mode);
+	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	return result;
+}
+
 /* ---- Pixel */
 
 /*!
 \brief Draw pixel  in currently set color.
 
+Added to the span batch instead when one is open on the renderer.
+
 \param renderer The renderer to draw on.
 \param x X (horizontal) coordinate of the pixel.
 \param y Y (vertical) coordinate of the pixel.
@@ -72,7 +359,7 @@ typedef struct {
 */
 int pixel(SDL_Renderer *renderer, Sint16 x, Sint16 y)
 {
-	return SDL_RenderDrawPoint(renderer, x, y);
+	return _gfxAddPoint(renderer, x, y);
 }
 
 /*!
@@ -107,9 +394,8 @@ int pixelColor(SDL_Renderer * renderer, Sint16 x, Sint16 y, Uint32 color)
 int pixelRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
 	int result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
-	result |= SDL_RenderDrawPoint(renderer, x, y);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= pixel(renderer, x, y);
 	return result;
 }
 
@@ -148,6 +434,8 @@ int pixelRGBAWeight(SDL_Renderer * renderer, Sint16 x, Sint16 y, Uint8 r, Uint8
 /*!
 \brief Draw horizontal line in currently set color
 
+Added to the span batch instead when one is open on the renderer.
+
 \param renderer The renderer to draw on.
 \param x1 X coordinate of the first point (i.e. left) of the line.
 \param x2 X coordinate of the second point (i.e. right) of the line.
@@ -157,7 +445,13 @@ int pixelRGBAWeight(SDL_Renderer * renderer, Sint16 x, Sint16 y, Uint8 r, Uint8
 */
 int hline(SDL_Renderer * renderer, Sint16 x1, Sint16 x2, Sint16 y)
 {
-	return SDL_RenderDrawLine(renderer, x1, y, x2, y);;
+	if ((gfxPrimitivesSpanDepth == 0) || (renderer != gfxPrimitivesSpanRenderer)) {
+		return SDL_RenderDrawLine(renderer, x1, y, x2, y);
+	}
+	if (x1 > x2) {
+		return _gfxAddSpan(renderer, x2, y, x1 - x2 + 1, 1);
+	}
+	return _gfxAddSpan(renderer, x1, y, x2 - x1 + 1, 1);
 }
 
 
@@ -195,9 +489,8 @@ int hlineColor(SDL_Renderer * renderer, Sint16 x1, Sint16 x2, Sint16 y, Uint32 c
 int hlineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 x2, Sint16 y, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
 	int result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
-	result |= SDL_RenderDrawLine(renderer, x1, y, x2, y);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= hline(renderer, x1, x2, y);
 	return result;
 }
 
@@ -206,6 +499,8 @@ int hlineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 x2, Sint16 y, Uint8 r,
 /*!
 \brief Draw vertical line in currently set color
 
+Added to the span batch instead when one is open on the renderer.
+
 \param renderer The renderer to draw on.
 \param x X coordinate of points of the line.
 \param y1 Y coordinate of the first point (i.e. top) of the line.
@@ -215,7 +510,13 @@ int hlineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 x2, Sint16 y, Uint8 r,
 */
 int vline(SDL_Renderer * renderer, Sint16 x, Sint16 y1, Sint16 y2)
 {
-	return SDL_RenderDrawLine(renderer, x, y1, x, y2);;
+	if ((gfxPrimitivesSpanDepth == 0) || (renderer != gfxPrimitivesSpanRenderer)) {
+		return SDL_RenderDrawLine(renderer, x, y1, x, y2);
+	}
+	if (y1 > y2) {
+		return _gfxAddSpan(renderer, x, y2, 1, y1 - y2 + 1);
+	}
+	return _gfxAddSpan(renderer, x, y1, 1, y2 - y1 + 1);
 }
 
 /*!
@@ -252,9 +553,8 @@ int vlineColor(SDL_Renderer * renderer, Sint16 x, Sint16 y1, Sint16 y2, Uint32 c
 int vlineRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y1, Sint16 y2, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
 	int result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
-	result |= SDL_RenderDrawLine(renderer, x, y1, x, y2);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= vline(renderer, x, y1, y2);
 	return result;
 }
 
@@ -344,8 +644,7 @@ int rectangleRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2, Sint
 	* Draw
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);	
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
 	result |= SDL_RenderDrawRect(renderer, &rect);
 	return result;
 }
@@ -633,8 +932,8 @@ int roundedBoxRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2,
 	* Set color
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= gfxPrimitivesBeginSpans(renderer);
 
 	/*
 	* Draw corners
@@ -690,6 +989,8 @@ int roundedBoxRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2,
 		result |= boxRGBA(renderer, x1, y1 + rad + 1, x2, y2 - rad, r, g, b, a);
 	}
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -779,9 +1080,8 @@ int boxRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2, Sint16 y2,
 	* Draw
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);	
-	result |= SDL_RenderFillRect(renderer, &rect);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= _gfxAddSpan(renderer, rect.x, rect.y, rect.w, rect.h);
 	return result;
 }
 
@@ -845,8 +1145,7 @@ int lineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2, Sint16 y2
 	* Draw
 	*/
 	int result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);	
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
 	result |= SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
 	return result;
 }
@@ -983,8 +1282,9 @@ int _aalineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2, Sint16
 	wgtcompmask = AAlevels - 1;
 
 	/*
-	* Draw the initial pixel in the foreground color 
+	* Draw the initial pixel in the foreground color; runs of equally weighted pixels are submitted together
 	*/
+	result |= gfxPrimitivesBeginSpans(renderer);
 	result |= pixelRGBA(renderer, x1, y1, r, g, b, a);
 
 	/*
@@ -1078,6 +1378,8 @@ int _aalineRGBA(SDL_Renderer * renderer, Sint16 x1, Sint16 y1, Sint16 x2, Sint16
 		result |= pixelRGBA (renderer, x2, y2, r, g, b, a);
 	}
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -1347,8 +1649,8 @@ int arcRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rad, Sint16 star
 	* Set color 
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= gfxPrimitivesBeginSpans(renderer);
 
 	/*
 	* Draw arc 
@@ -1414,6 +1716,8 @@ int arcRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rad, Sint16 star
 		cx++;
 	} while (cx <= cy);
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -1549,8 +1853,7 @@ int _ellipseRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rx, Sint16
 	* Set color
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
 
 	/*
 	* Special cases for rx=0 and/or ry=0: draw a hline/vline/pixel 
@@ -1566,6 +1869,11 @@ int _ellipseRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rx, Sint16
 			return (hline(renderer, x - rx, x + rx, y));
 		}
 	}
+
+	/*
+	* Submit the spans or points of the ellipse together
+	*/
+	result |= gfxPrimitivesBeginSpans(renderer);
 	
 	/*
  	 * Adjust overscan 
@@ -1674,6 +1982,8 @@ int _ellipseRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rx, Sint16
 		}
 	}
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -1884,7 +2194,8 @@ int aaellipseRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rx, Sint16
 
 	/* Draw */
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+	result |= gfxPrimitivesBeginSpans(renderer);
 
 	/* "End points" */
 	result |= pixelRGBA(renderer, xp, yp, r, g, b, a);
@@ -2007,6 +2318,8 @@ int aaellipseRGBA(SDL_Renderer * renderer, Sint16 x, Sint16 y, Sint16 rx, Sint16
 		result |= pixelRGBAWeight(renderer, xx, yy, r, g, b, a, weight);		
 	}
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -2589,8 +2902,7 @@ int polygonRGBA(SDL_Renderer * renderer, const Sint16 * vx, const Sint16 * vy, i
 	* Set color 
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);	
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
 
 	/*
 	* Draw 
@@ -2696,6 +3008,27 @@ int _gfxPrimitivesCompareInt(const void *a, const void *b)
 	return (*(const int *) a) - (*(const int *) b);
 }
 
+/*!
+\brief Internal helper qsort callback comparing polygon edge records by their top row.
+
+\param a The first edge record (y1, y2, x1, x2).
+\param b The second edge record (y1, y2, x1, x2).
+
+\returns Returns 0 if both start on the same row, a negative number if a starts above b or a positive number otherwise.
+*/
+static int _gfxPrimitivesCompareEdge(const void *a, const void *b)
+{
+	return (*(const int *) a) - (*(const int *) b);
+}
+
+/*!
+\brief Number of ints of temporary storage filledPolygonMT needs per polygon vertex.
+
+The temporary array holds the edge table (y1, y2, x1, x2 per edge) followed by the
+active edge list (x, edge, step quotient, step remainder per active edge).
+*/
+#define GFX_POLY_INTS_PER_VERTEX 8
+
 /*!
 \brief Global vertex array to use if optional parameters are not given in filledPolygonMT calls.
 
@@ -2715,6 +3048,10 @@ static int gfxPrimitivesPolyAllocatedGlobal = 0;
 
 Note: The last two parameters are optional; but are required for multithreaded operation.  
 
+The polygon is filled with an edge table and an active edge list, so the cost is
+proportional to the number of edges plus the number of spans drawn. Its spans go into
+the calling thread's span batch, see gfxPrimitivesBeginSpans.
+
 \param renderer The renderer to draw on.
 \param vx Vertex array containing X coordinates of the points of the filled polygon.
 \param vy Vertex array containing Y coordinates of the points of the filled polygon.
@@ -2731,13 +3068,17 @@ Note: The last two parameters are optional; but are required for multithreaded o
 int filledPolygonRGBAMT(SDL_Renderer * renderer, const Sint16 * vx, const Sint16 * vy, int n, Uint8 r, Uint8 g, Uint8 b, Uint8 a, int **polyInts, int *polyAllocated)
 {
 	int result;
-	int i;
+	int i, j, k;
 	int y, xa, xb;
 	int miny, maxy;
 	int x1, y1;
 	int x2, y2;
 	int ind1, ind2;
-	int ints;
+	int dy;
+	int nedges, nactive, next;
+	int *edges, *active, *e, *ae;
+	int entry[4];
+	int gfxPrimitivesPolyNeeded;
 	int *gfxPrimitivesPolyInts = NULL;
 	int *gfxPrimitivesPolyIntsNew = NULL;
 	int gfxPrimitivesPolyAllocated = 0;
@@ -2758,6 +3099,7 @@ int filledPolygonRGBAMT(SDL_Renderer * renderer, const Sint16 * vx, const Sint16
 	if (n < 3) {
 		return -1;
 	}
+	gfxPrimitivesPolyNeeded = GFX_POLY_INTS_PER_VERTEX * n;
 
 	/*
 	* Map polygon cache  
@@ -2776,11 +3118,11 @@ int filledPolygonRGBAMT(SDL_Renderer * renderer, const Sint16 * vx, const Sint16
 	* Allocate temp array, only grow array 
 	*/
 	if (!gfxPrimitivesPolyAllocated) {
-		gfxPrimitivesPolyInts = (int *) malloc(sizeof(int) * n);
-		gfxPrimitivesPolyAllocated = n;
+		gfxPrimitivesPolyInts = (int *) malloc(sizeof(int) * gfxPrimitivesPolyNeeded);
+		gfxPrimitivesPolyAllocated = gfxPrimitivesPolyNeeded;
 	} else {
-		if (gfxPrimitivesPolyAllocated < n) {
-			gfxPrimitivesPolyIntsNew = (int *) realloc(gfxPrimitivesPolyInts, sizeof(int) * n);
+		if (gfxPrimitivesPolyAllocated < gfxPrimitivesPolyNeeded) {
+			gfxPrimitivesPolyIntsNew = (int *) realloc(gfxPrimitivesPolyInts, sizeof(int) * gfxPrimitivesPolyNeeded);
 			if (!gfxPrimitivesPolyIntsNew) {
 				if (!gfxPrimitivesPolyInts) {
 					free(gfxPrimitivesPolyInts);
@@ -2789,7 +3131,7 @@ int filledPolygonRGBAMT(SDL_Renderer * renderer, const Sint16 * vx, const Sint16
 				gfxPrimitivesPolyAllocated = 0;
 			} else {
 				gfxPrimitivesPolyInts = gfxPrimitivesPolyIntsNew;
-				gfxPrimitivesPolyAllocated = n;
+				gfxPrimitivesPolyAllocated = gfxPrimitivesPolyNeeded;
 			}
 		}
 	}
@@ -2820,68 +3162,124 @@ int filledPolygonRGBAMT(SDL_Renderer * renderer, const Sint16 * vx, const Sint16
 	}
 
 	/*
-	* Determine Y maxima 
+	* Build the edge table and determine Y maxima. Horizontal edges
+	* never intersect a scanline and are left out.
 	*/
+	edges = gfxPrimitivesPolyInts;
+	active = gfxPrimitivesPolyInts + 4 * n;
+	nedges = 0;
 	miny = vy[0];
 	maxy = vy[0];
-	for (i = 1; (i < n); i++) {
+	for (i = 0; (i < n); i++) {
 		if (vy[i] < miny) {
 			miny = vy[i];
 		} else if (vy[i] > maxy) {
 			maxy = vy[i];
 		}
+		if (!i) {
+			ind1 = n - 1;
+			ind2 = 0;
+		} else {
+			ind1 = i - 1;
+			ind2 = i;
+		}
+		y1 = vy[ind1];
+		y2 = vy[ind2];
+		if (y1 < y2) {
+			x1 = vx[ind1];
+			x2 = vx[ind2];
+		} else if (y1 > y2) {
+			y2 = vy[ind1];
+			y1 = vy[ind2];
+			x2 = vx[ind1];
+			x1 = vx[ind2];
+		} else {
+			continue;
+		}
+		e = edges + 4 * nedges++;
+		e[0] = y1;
+		e[1] = y2;
+		e[2] = x1;
+		e[3] = x2;
 	}
 
 	/*
-	* Draw, scanning y 
+	* Bucket the edges by their top row once
+	*/
+	qsort(edges, nedges, 4 * sizeof(int), _gfxPrimitivesCompareEdge);
+
+	/*
+	* Set color 
 	*/
 	result = 0;
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
+
+	/*
+	* Draw, scanning y with an active edge list; the spans are submitted together
+	*/
+	result |= gfxPrimitivesBeginSpans(renderer);
+	next = 0;
+	nactive = 0;
 	for (y = miny; (y <= maxy); y++) {
-		ints = 0;
-		for (i = 0; (i < n); i++) {
-			if (!i) {
-				ind1 = n - 1;
-				ind2 = 0;
-			} else {
-				ind1 = i - 1;
-				ind2 = i;
-			}
-			y1 = vy[ind1];
-			y2 = vy[ind2];
-			if (y1 < y2) {
-				x1 = vx[ind1];
-				x2 = vx[ind2];
-			} else if (y1 > y2) {
-				y2 = vy[ind1];
-				y1 = vy[ind2];
-				x2 = vx[ind1];
-				x1 = vx[ind2];
-			} else {
-				continue;
-			}
-			if ( ((y >= y1) && (y < y2)) || ((y == maxy) && (y > y1) && (y <= y2)) ) {
-				gfxPrimitivesPolyInts[ints++] = ((65536 * (y - y1)) / (y2 - y1)) * (x2 - x1) + (65536 * x1);
-			} 	    
+		/*
+		* Activate the edges starting on this row
+		*/
+		while ((next < nedges) && (edges[4 * next] <= y)) {
+			ae = active + 4 * nactive++;
+			ae[1] = next++;
+			ae[2] = 0;
+			ae[3] = 0;
 		}
 
-		qsort(gfxPrimitivesPolyInts, ints, sizeof(int), _gfxPrimitivesCompareInt);
-
 		/*
-		* Set color 
+		* Drop finished edges, compute the intersection of the others and
+		* keep the list sorted by it. The order barely changes between rows,
+		* so insertion sort is close to linear.
 		*/
-		result = 0;
-	    result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-		result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);	
+		k = 0;
+		for (i = 0; (i < nactive); i++) {
+			ae = active + 4 * i;
+			e = edges + 4 * ae[1];
+			/* Edges ending on this row only count on the last row */
+			if ((y > e[1]) || ((y == e[1]) && (y != maxy))) {
+				continue;
+			}
 
-		for (i = 0; (i < ints); i += 2) {
-			xa = gfxPrimitivesPolyInts[i] + 1;
+			/*
+			* Same fixed point intersection as the plain scanline fill,
+			* (65536 * (y - y1)) / (y2 - y1) is stepped incrementally
+			*/
+			entry[0] = ae[2] * (e[3] - e[2]) + (65536 * e[2]);
+			entry[1] = ae[1];
+			entry[2] = ae[2];
+			entry[3] = ae[3];
+			dy = e[1] - e[0];
+			entry[2] += 65536 / dy;
+			entry[3] += 65536 % dy;
+			if (entry[3] >= dy) {
+				entry[2]++;
+				entry[3] -= dy;
+			}
+
+			for (j = k; (j > 0) && (active[4 * (j - 1)] > entry[0]); j--) {
+				memcpy(active + 4 * j, active + 4 * (j - 1), 4 * sizeof(int));
+			}
+			memcpy(active + 4 * j, entry, 4 * sizeof(int));
+			k++;
+		}
+		nactive = k;
+
+		for (i = 0; (i + 1 < nactive); i += 2) {
+			xa = active[4 * i] + 1;
 			xa = (xa >> 16) + ((xa & 32768) >> 15);
-			xb = gfxPrimitivesPolyInts[i+1] - 1;
+			xb = active[4 * (i + 1)] - 1;
 			xb = (xb >> 16) + ((xb & 32768) >> 15);
 			result |= hline(renderer, xa, xb, y);
 		}
 	}
 
+	result |= gfxPrimitivesEndSpans(renderer);
+
 	return (result);
 }
 
@@ -2948,6 +3346,11 @@ int _HLineTextured(SDL_Renderer *renderer, Sint16 x1, Sint16 x2, Sint16 y, SDL_T
 	SDL_Rect source_rect,dst_rect;
 	int pixels_written,write_width;
 
+	/*
+	* Textures bypass the span batch, draw the pending spans first
+	*/
+	gfxPrimitivesFlushSpans(renderer);
+
 	/*
 	* Swap x1, x2 if required to ensure x1<=x2
 	*/
@@ -3472,8 +3875,9 @@ int characterRGBA(SDL_Renderer *renderer, Sint16 x, Sint16 y, char c, Uint8 r, U
 	result |= SDL_SetTextureAlphaMod(gfxPrimitivesFont[ci], a);
 
 	/*
-	* Draw texture onto destination 
+	* Draw texture onto destination, after the pending spans
 	*/
+	result |= gfxPrimitivesFlushSpans(renderer);
 	result |= SDL_RenderCopy(renderer, gfxPrimitivesFont[ci], &srect, &drect);
 
 	return (result);
@@ -3694,8 +4098,7 @@ int bezierRGBA(SDL_Renderer * renderer, const Sint16 * vx, const Sint16 * vy, in
 	* Set color 
 	*/
 	result = 0;
-	result |= SDL_SetRenderDrawBlendMode(renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	result |= SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	result |= _gfxSetRenderDrawState(renderer, r, g, b, a);
 
 	/*
 	* Draw 
@@ -66,6 +66,12 @@ extern "C" {
 
 	/* Note: all ___Color routines expect the color to be in format 0xRRGGBBAA */
 
+	/* Span batching */
+
+	SDL2_GFXPRIMITIVES_SCOPE int gfxPrimitivesBeginSpans(SDL_Renderer * renderer);
+	SDL2_GFXPRIMITIVES_SCOPE int gfxPrimitivesEndSpans(SDL_Renderer * renderer);
+	SDL2_GFXPRIMITIVES_SCOPE int gfxPrimitivesFlushSpans(SDL_Renderer * renderer);
+
 	/* Pixel */
 
 	SDL2_GFXPRIMITIVES_SCOPE int pixelColor(SDL_Renderer * renderer, Sint16 x, Sint16 y, Uint32 color);
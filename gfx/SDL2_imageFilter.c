@@ -31,6 +31,8 @@ Andreas Schiffler -- aschiffler at ferzkopp dot net
 /*
 
 Note: Uses inline x86 MMX or ASM optimizations if available and enabled.
+On x86-64, where the inline assembly is not built, SSE2 intrinsics take
+their place, with AVX2 variants picked at runtime.
 
 Note: Most of the MMX code is based on published routines 
 by Vladimir Kravtchenko at vk@cs.ubc.ca - credits go to 
@@ -55,6 +57,20 @@ him for his work.
 
 #include "SDL2_imageFilter.h"
 
+/* SSE2 and AVX2 intrinsics replace the MMX routines where those are not built.
+   SSE2 is part of every x86-64 target, AVX2 is compiled per function and
+   only used if the CPU reports it. */
+#if !defined(USE_MMX) && (defined(__SSE2__) || defined(_M_X64))
+#  define USE_SSE2
+#  include <emmintrin.h>
+#  include <immintrin.h>
+#  if defined(__GNUC__) || defined(__clang__)
+#    define AVX2_TARGET __attribute__((target("avx2")))
+#  else
+#    define AVX2_TARGET
+#  endif
+#endif
+
 /*!
 \brief Swaps the byte order in a 32bit integer (LSB becomes MSB, etc.). 
 */
@@ -75,6 +91,8 @@ static int SDL_imageFilterUseMMX = 1;
 /*!
 \brief MMX detection routine (with override flag). 
 
+Without the MMX routines this reports the SSE2 routines instead.
+
 \returns 1 of MMX was detected, 0 otherwise.
 */
 int SDL_imageFilterMMXdetect(void)
@@ -84,7 +102,14 @@ int SDL_imageFilterMMXdetect(void)
 		return (0);
 	}
 
+#if defined(USE_MMX)
     return SDL_HasMMX();
+#elif defined(USE_SSE2)
+    return SDL_HasSSE2();
+#else
+	/* No vector routines built, the filters would skip all but the tail */
+    return (0);
+#endif
 }
 
 /*!
@@ -103,6 +128,162 @@ void SDL_imageFilterMMXon()
 	SDL_imageFilterUseMMX = 1;
 }
 
+#ifdef USE_SSE2
+
+/* ------------------------------------------------------------------------------------ */
+
+/* The operations below are written once for both vector widths: W is the intrinsic
+   prefix (_mm_ or _mm256_) and S the integer vector suffix (si128 or si256). They
+   work on whole vectors of bytes and give the same results as the C routines. */
+
+/* S/2 for every byte */
+#define SIMD_HALF(W, S, a)			W##and_##S(W##srli_epi16(a, 1), W##set1_epi8(0x7f))
+/* saturation255 of 16 bit products */
+#define SIMD_SAT255_16(W, S, p)		W##sub_epi16(p, W##subs_epu16(p, W##set1_epi16(255)))
+/* saturation255(S1 * S2), through 16 bit products of the low and high bytes */
+#define SIMD_MULSAT(W, S, a, b) \
+	W##packus_epi16( \
+		SIMD_SAT255_16(W, S, W##mullo_epi16(W##unpacklo_epi8(a, W##setzero_##S()), W##unpacklo_epi8(b, W##setzero_##S()))), \
+		SIMD_SAT255_16(W, S, W##mullo_epi16(W##unpackhi_epi8(a, W##setzero_##S()), W##unpackhi_epi8(b, W##setzero_##S()))))
+
+#define SIMD_ADD(W, S, a, b)			W##adds_epu8(a, b)
+#define SIMD_MEAN(W, S, a, b)			W##add_epi8(SIMD_HALF(W, S, a), SIMD_HALF(W, S, b))
+#define SIMD_SUB(W, S, a, b)			W##subs_epu8(a, b)
+#define SIMD_ABSDIFF(W, S, a, b)		W##or_##S(W##subs_epu8(a, b), W##subs_epu8(b, a))
+#define SIMD_MULT(W, S, a, b)			SIMD_MULSAT(W, S, a, b)
+/* the low byte of the product only depends on the low bytes, even and odd bytes are multiplied in place */
+#define SIMD_MULTNOR(W, S, a, b) \
+	W##or_##S(W##and_##S(W##mullo_epi16(a, b), W##set1_epi16(0xff)), \
+		W##slli_epi16(W##mullo_epi16(W##srli_epi16(a, 8), W##srli_epi16(b, 8)), 8))
+#define SIMD_MULTDIVBY2(W, S, a, b)		SIMD_MULSAT(W, S, SIMD_HALF(W, S, a), b)
+#define SIMD_MULTDIVBY4(W, S, a, b)		SIMD_MULSAT(W, S, SIMD_HALF(W, S, a), SIMD_HALF(W, S, b))
+#define SIMD_BITAND(W, S, a, b)			W##and_##S(a, b)
+#define SIMD_BITOR(W, S, a, b)			W##or_##S(a, b)
+
+/* unary operations take a constant C and a shift or second constant N */
+#define SIMD_BITNEGATION(W, S, a, C, N)	W##xor_##S(a, W##set1_epi8(-1))
+#define SIMD_ADDBYTE(W, S, a, C, N)		W##adds_epu8(a, W##set1_epi8((char)(C)))
+#define SIMD_ADDUINT(W, S, a, C, N)		W##adds_epu8(a, W##set1_epi32((int)(C)))
+#define SIMD_ADDBYTETOHALF(W, S, a, C, N)	W##adds_epu8(SIMD_HALF(W, S, a), W##set1_epi8((char)(C)))
+#define SIMD_SUBBYTE(W, S, a, C, N)		W##subs_epu8(a, W##set1_epi8((char)(C)))
+#define SIMD_SUBUINT(W, S, a, C, N)		W##subs_epu8(a, W##set1_epi32((int)(C)))
+/* 16 bit shifts, the bits shifted in from the neighbouring byte are masked off */
+#define SIMD_SHIFTRIGHT(W, S, a, C, N)	W##and_##S(W##srl_epi16(a, _mm_cvtsi32_si128(N)), W##set1_epi8((char)(0xff >> (N))))
+#define SIMD_SHIFTRIGHTUINT(W, S, a, C, N)	W##srl_epi32(a, _mm_cvtsi32_si128(N))
+#define SIMD_MULTBYBYTE(W, S, a, C, N)	SIMD_MULSAT(W, S, a, W##set1_epi8((char)(C)))
+#define SIMD_SHIFTRIGHTANDMULTBYBYTE(W, S, a, C, N)	SIMD_MULSAT(W, S, SIMD_SHIFTRIGHT(W, S, a, C, N), W##set1_epi8((char)(C)))
+#define SIMD_SHIFTLEFTBYTE(W, S, a, C, N)	W##and_##S(W##sll_epi16(a, _mm_cvtsi32_si128(N)), W##set1_epi8((char)((0xff << (N)) & 0xff)))
+#define SIMD_SHIFTLEFTUINT(W, S, a, C, N)	W##sll_epi32(a, _mm_cvtsi32_si128(N))
+/* bytes above 255 >> N saturate */
+#define SIMD_SHIFTLEFT(W, S, a, C, N) \
+	W##or_##S(SIMD_SHIFTLEFTBYTE(W, S, a, C, N), \
+		W##andnot_##S(W##cmpeq_epi8(W##min_epu8(a, W##set1_epi8((char)(0xff >> (N)))), a), W##set1_epi8(-1)))
+#define SIMD_BINARIZEUSINGTHRESHOLD(W, S, a, C, N)	W##cmpeq_epi8(W##max_epu8(a, W##set1_epi8((char)(C))), a)
+/* C is Tmin and N is Tmax, bytes below Tmin become Tmin even if Tmin > Tmax */
+#define SIMD_CLIPTORANGE(W, S, a, C, N) \
+	SIMD_SELECT(W, S, W##andnot_##S(W##cmpeq_epi8(W##max_epu8(a, W##set1_epi8((char)(C))), a), W##set1_epi8(-1)), \
+		W##set1_epi8((char)(C)), W##min_epu8(a, W##set1_epi8((char)(N))))
+#define SIMD_SELECT(W, S, mask, a, b)	W##or_##S(W##and_##S(mask, a), W##andnot_##S(mask, b))
+
+/* Defines the SSE2 and AVX2 loops of a filter over two sources and the routine picking one
+   of them. The length is a multiple of 8, the last 8 bytes may need a half vector. */
+#define SIMD_BINARY_FILTER(Name, OP) \
+static void SDL_imageFilter##Name##SSE2(unsigned char *Src1, unsigned char *Src2, unsigned char *Dest, unsigned int length) \
+{ \
+	unsigned int i; \
+	__m128i a, b; \
+	for (i = 0; i + 16 <= length; i += 16) { \
+		a = _mm_loadu_si128((const __m128i *)(Src1 + i)); \
+		b = _mm_loadu_si128((const __m128i *)(Src2 + i)); \
+		_mm_storeu_si128((__m128i *)(Dest + i), OP(_mm_, si128, a, b)); \
+	} \
+	if (i < length) { \
+		a = _mm_loadl_epi64((const __m128i *)(Src1 + i)); \
+		b = _mm_loadl_epi64((const __m128i *)(Src2 + i)); \
+		_mm_storel_epi64((__m128i *)(Dest + i), OP(_mm_, si128, a, b)); \
+	} \
+} \
+AVX2_TARGET static void SDL_imageFilter##Name##AVX2(unsigned char *Src1, unsigned char *Src2, unsigned char *Dest, unsigned int length) \
+{ \
+	unsigned int i; \
+	__m256i a, b; \
+	for (i = 0; i + 32 <= length; i += 32) { \
+		a = _mm256_loadu_si256((const __m256i *)(Src1 + i)); \
+		b = _mm256_loadu_si256((const __m256i *)(Src2 + i)); \
+		_mm256_storeu_si256((__m256i *)(Dest + i), OP(_mm256_, si256, a, b)); \
+	} \
+	SDL_imageFilter##Name##SSE2(Src1 + i, Src2 + i, Dest + i, length - i); \
+} \
+static void SDL_imageFilter##Name##SIMD(unsigned char *Src1, unsigned char *Src2, unsigned char *Dest, unsigned int length) \
+{ \
+	if (SDL_HasAVX2()) \
+		SDL_imageFilter##Name##AVX2(Src1, Src2, Dest, length); \
+	else \
+		SDL_imageFilter##Name##SSE2(Src1, Src2, Dest, length); \
+}
+
+/* the same for filters of one source */
+#define SIMD_UNARY_FILTER(Name, OP) \
+static void SDL_imageFilter##Name##SSE2(unsigned char *Src1, unsigned char *Dest, unsigned int length, unsigned int C, unsigned int N) \
+{ \
+	unsigned int i; \
+	__m128i a; \
+	for (i = 0; i + 16 <= length; i += 16) { \
+		a = _mm_loadu_si128((const __m128i *)(Src1 + i)); \
+		_mm_storeu_si128((__m128i *)(Dest + i), OP(_mm_, si128, a, C, N)); \
+	} \
+	if (i < length) { \
+		a = _mm_loadl_epi64((const __m128i *)(Src1 + i)); \
+		_mm_storel_epi64((__m128i *)(Dest + i), OP(_mm_, si128, a, C, N)); \
+	} \
+} \
+AVX2_TARGET static void SDL_imageFilter##Name##AVX2(unsigned char *Src1, unsigned char *Dest, unsigned int length, unsigned int C, unsigned int N) \
+{ \
+	unsigned int i; \
+	__m256i a; \
+	for (i = 0; i + 32 <= length; i += 32) { \
+		a = _mm256_loadu_si256((const __m256i *)(Src1 + i)); \
+		_mm256_storeu_si256((__m256i *)(Dest + i), OP(_mm256_, si256, a, C, N)); \
+	} \
+	SDL_imageFilter##Name##SSE2(Src1 + i, Dest + i, length - i, C, N); \
+} \
+static void SDL_imageFilter##Name##SIMD(unsigned char *Src1, unsigned char *Dest, unsigned int length, unsigned int C, unsigned int N) \
+{ \
+	if (SDL_HasAVX2()) \
+		SDL_imageFilter##Name##AVX2(Src1, Dest, length, C, N); \
+	else \
+		SDL_imageFilter##Name##SSE2(Src1, Dest, length, C, N); \
+}
+
+SIMD_BINARY_FILTER(Add, SIMD_ADD)
+SIMD_BINARY_FILTER(Mean, SIMD_MEAN)
+SIMD_BINARY_FILTER(Sub, SIMD_SUB)
+SIMD_BINARY_FILTER(AbsDiff, SIMD_ABSDIFF)
+SIMD_BINARY_FILTER(Mult, SIMD_MULT)
+SIMD_BINARY_FILTER(MultNor, SIMD_MULTNOR)
+SIMD_BINARY_FILTER(MultDivby2, SIMD_MULTDIVBY2)
+SIMD_BINARY_FILTER(MultDivby4, SIMD_MULTDIVBY4)
+SIMD_BINARY_FILTER(BitAnd, SIMD_BITAND)
+SIMD_BINARY_FILTER(BitOr, SIMD_BITOR)
+
+SIMD_UNARY_FILTER(BitNegation, SIMD_BITNEGATION)
+SIMD_UNARY_FILTER(AddByte, SIMD_ADDBYTE)
+SIMD_UNARY_FILTER(AddUint, SIMD_ADDUINT)
+SIMD_UNARY_FILTER(AddByteToHalf, SIMD_ADDBYTETOHALF)
+SIMD_UNARY_FILTER(SubByte, SIMD_SUBBYTE)
+SIMD_UNARY_FILTER(SubUint, SIMD_SUBUINT)
+SIMD_UNARY_FILTER(ShiftRight, SIMD_SHIFTRIGHT)
+SIMD_UNARY_FILTER(ShiftRightUint, SIMD_SHIFTRIGHTUINT)
+SIMD_UNARY_FILTER(MultByByte, SIMD_MULTBYBYTE)
+SIMD_UNARY_FILTER(ShiftRightAndMultByByte, SIMD_SHIFTRIGHTANDMULTBYBYTE)
+SIMD_UNARY_FILTER(ShiftLeftByte, SIMD_SHIFTLEFTBYTE)
+SIMD_UNARY_FILTER(ShiftLeftUint, SIMD_SHIFTLEFTUINT)
+SIMD_UNARY_FILTER(ShiftLeft, SIMD_SHIFTLEFT)
+SIMD_UNARY_FILTER(BinarizeUsingThreshold, SIMD_BINARIZEUSINGTHRESHOLD)
+SIMD_UNARY_FILTER(ClipToRange, SIMD_CLIPTORANGE)
+
+#endif
+
 /* ------------------------------------------------------------------------------------ */
 
 /*!
@@ -155,6 +336,9 @@ L1010:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterAddSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -290,6 +474,9 @@ L21011:
 	_m_empty();				/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMeanSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -404,6 +591,9 @@ L1012:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterSubSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -524,6 +714,9 @@ L1013:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterAbsDiffSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -711,6 +904,9 @@ L1014:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMultSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -844,6 +1040,9 @@ L10141:
 		);
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMultNorSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -982,6 +1181,9 @@ L1015:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMultDivby2SIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1123,6 +1325,9 @@ L1016:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMultDivby4SIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1260,6 +1465,9 @@ L1017:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterBitAndSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1374,6 +1582,9 @@ L91017:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterBitOrSIMD(Src1, Src2, Dest, SrcLength & 0xfffffff8);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1557,16 +1768,10 @@ int SDL_imageFilterDiv(unsigned char *Src1, unsigned char *Src2, unsigned char *
 	if (length == 0)
 		return(0);
 
-	if (SDL_imageFilterMMXdetect()) {
-		if (length > 0) {
-			/* Call ASM routine */
-			SDL_imageFilterDivASM(Src1, Src2, Dest, length);
-
-			/* Never unaligned bytes - we are done */
-			return (0);
-		} else {
-			return (-1);
-		}
+	/* Call ASM routine, there is none besides MMX */
+	if ((SDL_imageFilterMMXdetect()) && (SDL_imageFilterDivASM(Src1, Src2, Dest, length) == 0)) {
+		/* Never unaligned bytes - we are done */
+		return (0);
 	} 
 	
 	/* Setup to process whole image */
@@ -1654,6 +1859,9 @@ L91117:
 
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterBitNegationSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1772,6 +1980,9 @@ L1021:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterAddByteSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1803,7 +2014,7 @@ int SDL_imageFilterAddByte(unsigned char *Src1, unsigned char *Dest, unsigned in
 
 	/* Special case: C==0 */
 	if (C == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -1901,6 +2112,9 @@ L11023:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterAddUintSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -1932,7 +2146,7 @@ int SDL_imageFilterAddUint(unsigned char *Src1, unsigned char *Dest, unsigned in
 
 	/* Special case: C==0 */
 	if (C == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2050,6 +2264,9 @@ L1022:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterAddByteToHalfSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2178,6 +2395,9 @@ L1023:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterSubByteSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2209,7 +2429,7 @@ int SDL_imageFilterSubByte(unsigned char *Src1, unsigned char *Dest, unsigned in
 
 	/* Special case: C==0 */
 	if (C == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2307,6 +2527,9 @@ L11024:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterSubUintSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2338,7 +2561,7 @@ int SDL_imageFilterSubUint(unsigned char *Src1, unsigned char *Dest, unsigned in
 
     /* Special case: C==0 */
 	if (C == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2458,6 +2681,9 @@ L10241:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftRightSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2493,7 +2719,7 @@ int SDL_imageFilterShiftRight(unsigned char *Src1, unsigned char *Dest, unsigned
 
 	/* Special case: N==0 */
 	if (N == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2576,6 +2802,9 @@ L13023:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftRightUintSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2610,7 +2839,7 @@ int SDL_imageFilterShiftRightUint(unsigned char *Src1, unsigned char *Dest, unsi
 
 	/* Special case: N==0 */
 	if (N == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2639,7 +2868,7 @@ int SDL_imageFilterShiftRightUint(unsigned char *Src1, unsigned char *Dest, unsi
 	icursrc1=(unsigned int *)cursrc1;
 	icurdest=(unsigned int *)curdest;
 	for (i = istart; i < length; i += 4) {
-		if ((i+4)<length) {
+		if ((i+4)<=length) {
 			result = ((unsigned int)*icursrc1 >> N);
 			*icurdest = result;
 		}
@@ -2772,6 +3001,9 @@ L10252:
 	_m_empty();						/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterMultByByteSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2803,7 +3035,7 @@ int SDL_imageFilterMultByByte(unsigned char *Src1, unsigned char *Dest, unsigned
 
 	/* Special case: C==1 */
 	if (C == 1) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -2924,6 +3156,9 @@ L1026:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftRightAndMultByByteSIMD(Src1, Dest, SrcLength & 0xfffffff8, C, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -2962,7 +3197,7 @@ int SDL_imageFilterShiftRightAndMultByByte(unsigned char *Src1, unsigned char *D
 
 	/* Special case: N==0 && C==1 */
 	if ((N == 0) && (C == 1)) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -3075,6 +3310,9 @@ L10271:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftLeftByteSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -3109,7 +3347,7 @@ int SDL_imageFilterShiftLeftByte(unsigned char *Src1, unsigned char *Dest, unsig
 
 	/* Special case: N==0 */
 	if (N == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -3192,6 +3430,9 @@ L12023:
 	_m_empty();				/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftLeftUintSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -3226,7 +3467,7 @@ int SDL_imageFilterShiftLeftUint(unsigned char *Src1, unsigned char *Dest, unsig
 
 	/* Special case: N==0 */
 	if (N == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -3255,7 +3496,7 @@ int SDL_imageFilterShiftLeftUint(unsigned char *Src1, unsigned char *Dest, unsig
 	icursrc1=(unsigned int *)cursrc1;
 	icurdest=(unsigned int *)curdest;
 	for (i = istart; i < length; i += 4) {
-		if ((i+4)<length) {
+		if ((i+4)<=length) {
 			result = ((unsigned int)*icursrc1 << N);
 			*icurdest = result;
 		}
@@ -3375,6 +3616,9 @@ L10282:
 	_m_empty();						/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterShiftLeftSIMD(Src1, Dest, SrcLength & 0xfffffff8, 0, N);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -3408,7 +3652,7 @@ int SDL_imageFilterShiftLeft(unsigned char *Src1, unsigned char *Dest, unsigned
 
 	/* Special case: N==0 */
 	if (N == 0) {
-		memcpy(Src1, Dest, length);
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -3516,6 +3760,9 @@ L1029:
 	_m_empty();					/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterBinarizeUsingThresholdSIMD(Src1, Dest, SrcLength & 0xfffffff8, T, 0);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -3672,6 +3919,9 @@ L1030:
 	_m_empty();				/* clean MMX state */
 #endif
 	return (0);
+#elif defined(USE_SSE2)
+	SDL_imageFilterClipToRangeSIMD(Src1, Dest, SrcLength & 0xfffffff8, Tmin, Tmax);
+	return (0);
 #else
 	return (-1);
 #endif
@@ -3702,8 +3952,8 @@ int SDL_imageFilterClipToRange(unsigned char *Src1, unsigned char *Dest, unsigne
 		return(0);
 
 	/* Special case: Tmin==0 && Tmax = 255 */
-	if ((Tmin == 0) && (Tmax == 25)) {
-		memcpy(Src1, Dest, length);
+	if ((Tmin == 0) && (Tmax == 255)) {
+		memmove(Dest, Src1, length);
 		return (0); 
 	}
 
@@ -3921,9 +4171,9 @@ int SDL_imageFilterNormalizeLinear(unsigned char *Src, unsigned char *Dest, unsi
 	if (length == 0)
 		return(0);
 
-	if ((SDL_imageFilterMMXdetect()) && (length > 7)) {
-
-		SDL_imageFilterNormalizeLinearMMX(Src, Dest, length, Cmin, Cmax, Nmin, Nmax);
+	/* There is no routine besides MMX, fall back to C without it */
+	if ((SDL_imageFilterMMXdetect()) && (length > 7)
+		&& (SDL_imageFilterNormalizeLinearMMX(Src, Dest, length, Cmin, Cmax, Nmin, Nmax) == 0)) {
 
 		/* Check for unaligned bytes */
 		if ((length & 7) > 0) {
@@ -3963,6 +4213,181 @@ int SDL_imageFilterNormalizeLinear(unsigned char *Src, unsigned char *Dest, unsi
 
 /* ------------------------------------------------------------------------------------ */
 
+/*!
+\brief Empties a filter pipeline.
+
+\param pipeline Pointer to the pipeline to initialize.
+*/
+void SDL_imageFilterPipelineInit(SDL_imageFilterPipeline *pipeline)
+{
+	if (pipeline == NULL)
+		return;
+	pipeline->count = 0;
+}
+
+/*!
+\brief Appends a stage to a filter pipeline.
+
+\param pipeline Pointer to the pipeline.
+\param op The filter the stage runs.
+\param Src2 Pointer to the start of the second source byte array (S2) of two source filters, ignored otherwise.
+\param C The constant of the filter (C, T or Tmin), if any.
+\param N The shift of the filter (N or Tmax), if any.
+
+\return Returns 0 for success or -1 for error.
+*/
+int SDL_imageFilterPipelineAdd(SDL_imageFilterPipeline *pipeline, SDL_imageFilterOp op, unsigned char *Src2, unsigned int C,
+							   unsigned int N)
+{
+	SDL_imageFilterStage *stage;
+
+	/* Validate input parameters */
+	if (pipeline == NULL)
+		return(-1);
+	if (pipeline->count >= SDL_IMAGEFILTER_PIPELINE_MAX_STAGES)
+		return(-1);
+	if ((op <= SDL_IMAGEFILTER_DIV) && (Src2 == NULL))
+		return(-1);
+
+	stage = &pipeline->stages[pipeline->count++];
+	stage->op = op;
+	stage->Src2 = Src2;
+	stage->C = C;
+	stage->N = N;
+	return (0);
+}
+
+/*!
+\brief Internal routine running one pipeline stage over a chunk.
+
+\param stage Pointer to the stage.
+\param Src1 Pointer to the running image of the chunk (S1).
+\param offset The offset of the chunk in the image, to find the chunk of S2.
+\param Dest Pointer to the destination of the chunk (D).
+\param length The number of bytes in the chunk.
+
+\return Returns 0 for success or -1 for error.
+*/
+static int SDL_imageFilterPipelineStage(SDL_imageFilterStage *stage, unsigned char *Src1, unsigned int offset,
+										unsigned char *Dest, unsigned int length)
+{
+	unsigned char *Src2 = stage->Src2 + offset;
+	unsigned char C = (unsigned char)stage->C;
+	unsigned char N = (unsigned char)stage->N;
+
+	/* The uint shifts leave the bytes after the last whole uint alone, they keep the running value */
+	if (((stage->op == SDL_IMAGEFILTER_SHIFTRIGHTUINT) || (stage->op == SDL_IMAGEFILTER_SHIFTLEFTUINT)) && (Src1 != Dest))
+		memcpy(&Dest[length & 0xfffffffc], &Src1[length & 0xfffffffc], length & 3);
+
+	switch (stage->op) {
+	case SDL_IMAGEFILTER_ADD:
+		return SDL_imageFilterAdd(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_MEAN:
+		return SDL_imageFilterMean(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_SUB:
+		return SDL_imageFilterSub(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_ABSDIFF:
+		return SDL_imageFilterAbsDiff(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_MULT:
+		return SDL_imageFilterMult(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_MULTNOR:
+		return SDL_imageFilterMultNor(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_MULTDIVBY2:
+		return SDL_imageFilterMultDivby2(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_MULTDIVBY4:
+		return SDL_imageFilterMultDivby4(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_BITAND:
+		return SDL_imageFilterBitAnd(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_BITOR:
+		return SDL_imageFilterBitOr(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_DIV:
+		return SDL_imageFilterDiv(Src1, Src2, Dest, length);
+	case SDL_IMAGEFILTER_BITNEGATION:
+		return SDL_imageFilterBitNegation(Src1, Dest, length);
+	case SDL_IMAGEFILTER_ADDBYTE:
+		return SDL_imageFilterAddByte(Src1, Dest, length, C);
+	case SDL_IMAGEFILTER_ADDUINT:
+		return SDL_imageFilterAddUint(Src1, Dest, length, stage->C);
+	case SDL_IMAGEFILTER_ADDBYTETOHALF:
+		return SDL_imageFilterAddByteToHalf(Src1, Dest, length, C);
+	case SDL_IMAGEFILTER_SUBBYTE:
+		return SDL_imageFilterSubByte(Src1, Dest, length, C);
+	case SDL_IMAGEFILTER_SUBUINT:
+		return SDL_imageFilterSubUint(Src1, Dest, length, stage->C);
+	case SDL_IMAGEFILTER_SHIFTRIGHT:
+		return SDL_imageFilterShiftRight(Src1, Dest, length, N);
+	case SDL_IMAGEFILTER_SHIFTRIGHTUINT:
+		return SDL_imageFilterShiftRightUint(Src1, Dest, length, N);
+	case SDL_IMAGEFILTER_MULTBYBYTE:
+		return SDL_imageFilterMultByByte(Src1, Dest, length, C);
+	case SDL_IMAGEFILTER_SHIFTRIGHTANDMULTBYBYTE:
+		return SDL_imageFilterShiftRightAndMultByByte(Src1, Dest, length, N, C);
+	case SDL_IMAGEFILTER_SHIFTLEFTBYTE:
+		return SDL_imageFilterShiftLeftByte(Src1, Dest, length, N);
+	case SDL_IMAGEFILTER_SHIFTLEFTUINT:
+		return SDL_imageFilterShiftLeftUint(Src1, Dest, length, N);
+	case SDL_IMAGEFILTER_SHIFTLEFT:
+		return SDL_imageFilterShiftLeft(Src1, Dest, length, N);
+	case SDL_IMAGEFILTER_BINARIZEUSINGTHRESHOLD:
+		return SDL_imageFilterBinarizeUsingThreshold(Src1, Dest, length, C);
+	case SDL_IMAGEFILTER_CLIPTORANGE:
+		return SDL_imageFilterClipToRange(Src1, Dest, length, C, N);
+	}
+	return (-1);
+}
+
+/*!
+\brief Runs a filter pipeline: D = stages(S1)
+
+The image goes through the pipeline a chunk at a time. The first stage reads the chunk of S1,
+the stages in between work on a copy of the chunk that stays in the cache and the last one
+writes the chunk of D. Chunks are a multiple of 8 bytes, so every filter splits its work
+between the vector and the C routine just as over the whole image, and the result is the same
+as calling the filters one after another. D may be S1 or one of the second sources.
+
+\param pipeline Pointer to the pipeline.
+\param Src1 Pointer to the start of the source byte array (S1).
+\param Dest Pointer to the start of the destination byte array (D).
+\param length The number of bytes in the source array.
+
+\return Returns 0 for success or -1 for error.
+*/
+int SDL_imageFilterPipelineRun(SDL_imageFilterPipeline *pipeline, unsigned char *Src1, unsigned char *Dest, unsigned int length)
+{
+	unsigned int offset, chunk;
+	int i, last;
+	unsigned char *cursrc, *curdst;
+
+	/* Validate input parameters */
+	if ((pipeline == NULL) || (Src1 == NULL) || (Dest == NULL))
+		return(-1);
+	if (length == 0)
+		return(0);
+
+	/* An empty pipeline copies */
+	if (pipeline->count == 0) {
+		memmove(Dest, Src1, length);
+		return (0);
+	}
+
+	last = pipeline->count - 1;
+	for (offset = 0; offset < length; offset += chunk) {
+		chunk = length - offset;
+		if (chunk > SDL_IMAGEFILTER_PIPELINE_CHUNK)
+			chunk = SDL_IMAGEFILTER_PIPELINE_CHUNK;
+		for (i = 0; i <= last; i++) {
+			cursrc = (i == 0) ? &Src1[offset] : pipeline->chunk;
+			curdst = (i == last) ? &Dest[offset] : pipeline->chunk;
+			if (SDL_imageFilterPipelineStage(&pipeline->stages[i], cursrc, offset, curdst, chunk) != 0)
+				return (-1);
+		}
+	}
+
+	return (0);
+}
+
+/* ------------------------------------------------------------------------------------ */
+
 /*!
 \brief Filter using ConvolveKernel3x3Divide: Dij = saturation0and255( ... ) 
 
@@ -158,6 +158,73 @@ extern "C" {
 	SDL2_IMAGEFILTER_SCOPE int SDL_imageFilterNormalizeLinear(unsigned char *Src, unsigned char *Dest, unsigned int length, int Cmin,
 		int Cmax, int Nmin, int Nmax);
 
+	//
+	// Pipelines: a chain of the filters above run as one pass. The image is processed in
+	// chunks small enough to stay in the cache, every stage runs over a chunk before the
+	// next chunk is read, so each source and the destination go through memory once.
+	//
+
+#define SDL_IMAGEFILTER_PIPELINE_MAX_STAGES 16
+#define SDL_IMAGEFILTER_PIPELINE_CHUNK 4096
+
+	typedef enum {
+		// stages combining the running image (S1) with a second source (S2)
+		SDL_IMAGEFILTER_ADD,
+		SDL_IMAGEFILTER_MEAN,
+		SDL_IMAGEFILTER_SUB,
+		SDL_IMAGEFILTER_ABSDIFF,
+		SDL_IMAGEFILTER_MULT,
+		SDL_IMAGEFILTER_MULTNOR,
+		SDL_IMAGEFILTER_MULTDIVBY2,
+		SDL_IMAGEFILTER_MULTDIVBY4,
+		SDL_IMAGEFILTER_BITAND,
+		SDL_IMAGEFILTER_BITOR,
+		SDL_IMAGEFILTER_DIV,
+		// stages on the running image alone, with the constant C and the shift N
+		SDL_IMAGEFILTER_BITNEGATION,
+		SDL_IMAGEFILTER_ADDBYTE,
+		SDL_IMAGEFILTER_ADDUINT,
+		SDL_IMAGEFILTER_ADDBYTETOHALF,
+		SDL_IMAGEFILTER_SUBBYTE,
+		SDL_IMAGEFILTER_SUBUINT,
+		SDL_IMAGEFILTER_SHIFTRIGHT,
+		SDL_IMAGEFILTER_SHIFTRIGHTUINT,
+		SDL_IMAGEFILTER_MULTBYBYTE,
+		SDL_IMAGEFILTER_SHIFTRIGHTANDMULTBYBYTE,
+		SDL_IMAGEFILTER_SHIFTLEFTBYTE,
+		SDL_IMAGEFILTER_SHIFTLEFTUINT,
+		SDL_IMAGEFILTER_SHIFTLEFT,
+		// C is the threshold T
+		SDL_IMAGEFILTER_BINARIZEUSINGTHRESHOLD,
+		// C is Tmin, N is Tmax
+		SDL_IMAGEFILTER_CLIPTORANGE
+	} SDL_imageFilterOp;
+
+	typedef struct {
+		SDL_imageFilterOp op;
+		unsigned char *Src2;
+		unsigned int C;
+		unsigned int N;
+	} SDL_imageFilterStage;
+
+	typedef struct {
+		int count;
+		SDL_imageFilterStage stages[SDL_IMAGEFILTER_PIPELINE_MAX_STAGES];
+		// the running image of the chunk in flight
+		unsigned char chunk[SDL_IMAGEFILTER_PIPELINE_CHUNK];
+	} SDL_imageFilterPipeline;
+
+	//  SDL_imageFilterPipelineInit: empties the pipeline
+	SDL2_IMAGEFILTER_SCOPE void SDL_imageFilterPipelineInit(SDL_imageFilterPipeline *pipeline);
+
+	//  SDL_imageFilterPipelineAdd: appends a stage, Src2 is only used by the two source stages
+	SDL2_IMAGEFILTER_SCOPE int SDL_imageFilterPipelineAdd(SDL_imageFilterPipeline *pipeline, SDL_imageFilterOp op,
+		unsigned char *Src2, unsigned int C, unsigned int N);
+
+	//  SDL_imageFilterPipelineRun: D = stages(S1), same result as calling the filters one after another
+	SDL2_IMAGEFILTER_SCOPE int SDL_imageFilterPipelineRun(SDL_imageFilterPipeline *pipeline, unsigned char *Src1,
+		unsigned char *Dest, unsigned int length);
+
 	/* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
@@ -36,6 +36,13 @@ Andreas Schiffler -- aschiffler at ferzkopp dot net
 
 #include "SDL2_rotozoom.h"
 
+/* SSE2 is part of every x86-64 target, the 32 bit zoomers and the shrinker
+   process 4 pixels per iteration with it. */
+#if defined(__SSE2__) || defined(_M_X64)
+#  define USE_SSE2
+#  include <emmintrin.h>
+#endif
+
 /* ---- Internally used structures */
 
 /*!
@@ -77,6 +84,35 @@ to a situation where the program can segfault.
 */
 #define VALUE_LIMIT	0.001
 
+/*!
+\brief Maximum number of threads the 32 bit zoomers and the shrinker split their rows across.
+*/
+#define ROW_BAND_MAX_THREADS (16)
+
+/*!
+\brief Minimum number of pixels per row band for the band to get its own thread.
+*/
+#define ROW_BAND_MIN_PIXELS (65536)
+
+/*!
+\brief A band of destination rows processed by one thread.
+
+Carries the parameters of all 32 bit zoomers, each only reads its own.
+*/
+typedef struct tRowBand {
+	void (*rows)(struct tRowBand *band);
+	SDL_Surface *src;
+	SDL_Surface *dst;
+	int y0, y1;
+	int flipx, flipy, smooth;
+	/* zoom: precalculated row/column increments */
+	int *sax, *say;
+	/* rotozoom: center and integer sine/cosine */
+	int cx, cy, isin, icos;
+	/* shrink: integer factors */
+	int factorx, factory;
+} tRowBand;
+
 /*!
 \brief Returns colorkey info for a surface
 */
@@ -87,91 +123,281 @@ Uint32 _colorkey(SDL_Surface *src)
 	return key;
 }
 
+/*!
+\brief Thread function processing a single row band.
+*/
+static int _rowBandThread(void *data)
+{
+	tRowBand *band = (tRowBand *) data;
+	band->rows(band);
+	return (0);
+}
 
-/*! 
-\brief Internal 32 bit integer-factor averaging Shrinker.
+/*!
+\brief Splits the destination rows into bands and processes them on parallel threads.
 
-Shrinks 32 bit RGBA/ABGR 'src' surface to 'dst' surface.
-Averages color and alpha values values of src pixels to calculate dst pixels.
-Assumes src and dst surfaces are of 32 bit depth.
-Assumes dst surface was allocated with the correct dimensions.
+The calling thread processes the first band itself. Small jobs and bands whose
+thread could not be created are processed on the calling thread. The bands write
+disjoint destination rows, so the result does not depend on the number of threads.
 
-\param src The surface to shrink (input).
-\param dst The shrunken surface (output).
-\param factorx The horizontal shrinking ratio.
-\param factory The vertical shrinking ratio.
+\param job Band covering all destination rows.
+\param pixels Number of pixels the whole job reads or writes, sizes the bands.
+*/
+static void _processRowBands(tRowBand *job, int pixels)
+{
+	tRowBand bands[ROW_BAND_MAX_THREADS];
+	SDL_Thread *threads[ROW_BAND_MAX_THREADS];
+	int i, count, rows;
+
+	rows = job->y1 - job->y0;
+	count = SDL_GetCPUCount();
+	if (count > ROW_BAND_MAX_THREADS) count = ROW_BAND_MAX_THREADS;
+	if (count > pixels / ROW_BAND_MIN_PIXELS) count = pixels / ROW_BAND_MIN_PIXELS;
+	if (count > rows) count = rows;
+	if (count <= 1) {
+		job->rows(job);
+		return;
+	}
 
-\return 0 for success or -1 for error.
+	for (i = 0; i < count; i++) {
+		bands[i] = *job;
+		bands[i].y0 = job->y0 + rows * i / count;
+		bands[i].y1 = job->y0 + rows * (i + 1) / count;
+	}
+	for (i = 1; i < count; i++) {
+		threads[i] = SDL_CreateThread(_rowBandThread, "rotozoom", &bands[i]);
+	}
+	bands[0].rows(&bands[0]);
+	for (i = 1; i < count; i++) {
+		if (threads[i] == NULL) {
+			bands[i].rows(&bands[i]);
+		} else {
+			SDL_WaitThread(threads[i], NULL);
+		}
+	}
+}
+
+/*!
+\brief Bilinear interpolation of one 32 bit pixel.
+
+\param dp The destination pixel.
+\param c00 The top left source pixel.
+\param c01 The top right source pixel.
+\param c10 The bottom left source pixel.
+\param c11 The bottom right source pixel.
+\param ex Horizontal weight, the fraction of a 16.16 fixed point coordinate.
+\param ey Vertical weight, the fraction of a 16.16 fixed point coordinate.
 */
-int _shrinkSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int factorx, int factory)
+static void _interpolateRGBA(tColorRGBA *dp, const tColorRGBA *c00, const tColorRGBA *c01, const tColorRGBA *c10, const tColorRGBA *c11, int ex, int ey)
 {
-	int x, y, dx, dy, dgap, ra, ga, ba, aa;
-	int n_average;
-	tColorRGBA *sp, *osp, *oosp;
-	tColorRGBA *dp;
+	int t1, t2;
+
+	t1 = ((((c01->r - c00->r) * ex) >> 16) + c00->r) & 0xff;
+	t2 = ((((c11->r - c10->r) * ex) >> 16) + c10->r) & 0xff;
+	dp->r = (((t2 - t1) * ey) >> 16) + t1;
+	t1 = ((((c01->g - c00->g) * ex) >> 16) + c00->g) & 0xff;
+	t2 = ((((c11->g - c10->g) * ex) >> 16) + c10->g) & 0xff;
+	dp->g = (((t2 - t1) * ey) >> 16) + t1;
+	t1 = ((((c01->b - c00->b) * ex) >> 16) + c00->b) & 0xff;
+	t2 = ((((c11->b - c10->b) * ex) >> 16) + c10->b) & 0xff;
+	dp->b = (((t2 - t1) * ey) >> 16) + t1;
+	t1 = ((((c01->a - c00->a) * ex) >> 16) + c00->a) & 0xff;
+	t2 = ((((c11->a - c10->a) * ex) >> 16) + c10->a) & 0xff;
+	dp->a = (((t2 - t1) * ey) >> 16) + t1;
+}
 
-	/*
-	* Averaging integer shrink
-	*/
+#ifdef USE_SSE2
+/*!
+\brief Interpolates 16 bit channel lanes a towards b by unsigned 16 bit weights w.
 
-	/* Precalculate division factor */
-	n_average = factorx*factory;
+Matches (((b - a) * w) >> 16) + a of the scalar code bit for bit. The multiply
+treats the weights as signed, weights of 32768 and more are corrected by adding
+b - a back.
+*/
+static __m128i _lerpRGBA16(__m128i a, __m128i b, __m128i w)
+{
+	__m128i d, p;
 
-	/*
-	* Scan destination
-	*/
-	sp = (tColorRGBA *) src->pixels;
-	
-	dp = (tColorRGBA *) dst->pixels;
-	dgap = dst->pitch - dst->w * 4;
+	d = _mm_sub_epi16(b, a);
+	p = _mm_mulhi_epi16(d, w);
+	p = _mm_add_epi16(p, _mm_and_si128(d, _mm_srai_epi16(w, 15)));
+	return _mm_add_epi16(a, p);
+}
 
-	for (y = 0; y < dst->h; y++) {
+/*!
+\brief Bilinear interpolation of 4 32 bit pixels, bit identical to _interpolateRGBA.
 
-		osp=sp;
-		for (x = 0; x < dst->w; x++) {
+\param c00 The top left source pixels.
+\param c01 The top right source pixels.
+\param c10 The bottom left source pixels.
+\param c11 The bottom right source pixels.
+\param ex Horizontal weights, the low 16 bits of each 32 bit lane.
+\param ey Vertical weights, the low 16 bits of each 32 bit lane.
 
-			/* Trace out source box and accumulate */
-			oosp=sp;
-			ra=ga=ba=aa=0;
-			for (dy=0; dy < factory; dy++) {
-				for (dx=0; dx < factorx; dx++) {
-					ra += sp->r;
-					ga += sp->g;
-					ba += sp->b;
-					aa += sp->a;
+\return The 4 interpolated pixels.
+*/
+static __m128i _interpolateRGBA4(__m128i c00, __m128i c01, __m128i c10, __m128i c11, __m128i ex, __m128i ey)
+{
+	__m128i zero, exlo, exhi, eylo, eyhi, lo, hi;
+
+	/* Spread the weight of each pixel over its 4 channels */
+	exlo = _mm_unpacklo_epi64(ex, ex);
+	exlo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(exlo, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(2, 2, 2, 2));
+	exhi = _mm_unpackhi_epi64(ex, ex);
+	exhi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(exhi, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(2, 2, 2, 2));
+	eylo = _mm_unpacklo_epi64(ey, ey);
+	eylo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(eylo, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(2, 2, 2, 2));
+	eyhi = _mm_unpackhi_epi64(ey, ey);
+	eyhi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(eyhi, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(2, 2, 2, 2));
+
+	zero = _mm_setzero_si128();
+	lo = _lerpRGBA16(
+		_lerpRGBA16(_mm_unpacklo_epi8(c00, zero), _mm_unpacklo_epi8(c01, zero), exlo),
+		_lerpRGBA16(_mm_unpacklo_epi8(c10, zero), _mm_unpacklo_epi8(c11, zero), exlo),
+		eylo);
+	hi = _lerpRGBA16(
+		_lerpRGBA16(_mm_unpackhi_epi8(c00, zero), _mm_unpackhi_epi8(c01, zero), exhi),
+		_lerpRGBA16(_mm_unpackhi_epi8(c10, zero), _mm_unpackhi_epi8(c11, zero), exhi),
+		eyhi);
+	return _mm_packus_epi16(lo, hi);
+}
 
-					sp++;
-				} 
-				/* src dx loop */
-				sp = (tColorRGBA *)((Uint8*)sp + (src->pitch - 4*factorx)); // next y
+/*!
+\brief Loads 4 32 bit pixels from arbitrary offsets.
+*/
+static __m128i _gatherRGBA4(const Uint32 *sp, const int *o, int offset)
+{
+	return _mm_setr_epi32((int) sp[o[0] + offset], (int) sp[o[1] + offset], (int) sp[o[2] + offset], (int) sp[o[3] + offset]);
+}
+#endif
+
+
+/*!
+\brief Sums the channels of a box of 32 bit pixels.
+
+\param sp The top left pixel of the box.
+\param pitch The source pitch in bytes.
+\param factorx The box width.
+\param factory The box height.
+\param sum The channel sums (output).
+*/
+static void _sumBoxRGBA(tColorRGBA *sp, int pitch, int factorx, int factory, int *sum)
+{
+	int dx, dy;
+
+#ifdef USE_SSE2
+	/* 16 bit lanes sum at most 256 pixels of a box row */
+	if (factorx <= 512) {
+		__m128i zero, acc, row, v;
+		Uint32 *p;
+
+		zero = _mm_setzero_si128();
+		acc = _mm_setzero_si128();
+		for (dy = 0; dy < factory; dy++) {
+			p = (Uint32 *) ((Uint8 *) sp + dy * pitch);
+			row = _mm_setzero_si128();
+			for (dx = 0; dx + 4 <= factorx; dx += 4) {
+				v = _mm_loadu_si128((__m128i *) (p + dx));
+				row = _mm_add_epi16(row, _mm_unpacklo_epi8(v, zero));
+				row = _mm_add_epi16(row, _mm_unpackhi_epi8(v, zero));
+			}
+			if (dx + 2 <= factorx) {
+				v = _mm_loadl_epi64((__m128i *) (p + dx));
+				row = _mm_add_epi16(row, _mm_unpacklo_epi8(v, zero));
+				dx += 2;
 			}
-			/* src dy loop */
+			if (dx < factorx) {
+				v = _mm_cvtsi32_si128((int) p[dx]);
+				row = _mm_add_epi16(row, _mm_unpacklo_epi8(v, zero));
+			}
+			/* Fold the two pixel halves into 32 bit channel sums */
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(row, zero));
+			acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(row, zero));
+		}
+		_mm_storeu_si128((__m128i *) sum, acc);
+		return;
+	}
+#endif
 
-			/* next box-x */
-			sp = (tColorRGBA *)((Uint8*)oosp + 4*factorx);
+	sum[0] = sum[1] = sum[2] = sum[3] = 0;
+	for (dy = 0; dy < factory; dy++) {
+		for (dx = 0; dx < factorx; dx++) {
+			sum[0] += sp->r;
+			sum[1] += sp->g;
+			sum[2] += sp->b;
+			sum[3] += sp->a;
+
+			sp++;
+		}
+		/* src dx loop */
+		sp = (tColorRGBA *)((Uint8*)sp + (pitch - 4*factorx)); // next y
+	}
+	/* src dy loop */
+}
+
+/*!
+\brief Shrinks a band of rows of a 32 bit surface.
+*/
+static void _shrinkRowsRGBA(tRowBand *band)
+{
+	SDL_Surface *src = band->src;
+	SDL_Surface *dst = band->dst;
+	int x, y, n_average, sum[4];
+	tColorRGBA *sp, *dp;
+
+	/* Precalculate division factor */
+	n_average = band->factorx*band->factory;
+
+	for (y = band->y0; y < band->y1; y++) {
+		sp = (tColorRGBA *) ((Uint8 *) src->pixels + src->pitch*band->factory*y);
+		dp = (tColorRGBA *) ((Uint8 *) dst->pixels + dst->pitch*y);
+		for (x = 0; x < dst->w; x++) {
+			/* Trace out source box and accumulate */
+			_sumBoxRGBA(sp, src->pitch, band->factorx, band->factory, sum);
 
 			/* Store result in destination */
-			dp->r = ra/n_average;
-			dp->g = ga/n_average;
-			dp->b = ba/n_average;
-			dp->a = aa/n_average;
+			dp->r = sum[0]/n_average;
+			dp->g = sum[1]/n_average;
+			dp->b = sum[2]/n_average;
+			dp->a = sum[3]/n_average;
 
-			/*
-			* Advance destination pointer 
-			*/
+			/* next box-x */
+			sp += band->factorx;
 			dp++;
-		} 
-		/* dst x loop */
+		}
+	}
+}
 
-		/* next box-y */
-		sp = (tColorRGBA *)((Uint8*)osp + src->pitch*factory);
+/*! 
+\brief Internal 32 bit integer-factor averaging Shrinker.
 
-		/*
-		* Advance destination pointers 
-		*/
-		dp = (tColorRGBA *) ((Uint8 *) dp + dgap);
-	} 
-	/* dst y loop */
+Shrinks 32 bit RGBA/ABGR 'src' surface to 'dst' surface.
+Averages color and alpha values values of src pixels to calculate dst pixels.
+Assumes src and dst surfaces are of 32 bit depth.
+Assumes dst surface was allocated with the correct dimensions.
+
+\param src The surface to shrink (input).
+\param dst The shrunken surface (output).
+\param factorx The horizontal shrinking ratio.
+\param factory The vertical shrinking ratio.
+
+\return 0 for success or -1 for error.
+*/
+int _shrinkSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int factorx, int factory)
+{
+	tRowBand band;
+
+	/*
+	* Averaging integer shrink, bands of destination rows in parallel
+	*/
+	memset(&band, 0, sizeof(band));
+	band.rows = _shrinkRowsRGBA;
+	band.src = src;
+	band.dst = dst;
+	band.y1 = dst->h;
+	band.factorx = factorx;
+	band.factory = factory;
+	_processRowBands(&band, dst->w * factorx * dst->h * factory);
 
 	return (0);
 }
@@ -259,6 +485,84 @@ int _shrinkSurfaceY(SDL_Surface * src, SDL_Surface * dst, int factorx, int facto
 	return (0);
 }
 
+/*!
+\brief Zooms a band of rows of a 32 bit surface.
+
+Each destination row is located directly from the precalculated increments,
+so bands can start at any row.
+*/
+static void _zoomRowsRGBA(tRowBand *band)
+{
+	SDL_Surface *src = band->src;
+	SDL_Surface *dst = band->dst;
+	int x, y, o, cx, cy, ex, ey, spixelw, spixelh, spixelgap, step, xstep, ystep;
+	Uint32 *sp, *csp;
+	tColorRGBA *dp;
+#ifdef USE_SSE2
+	int i, o0[4], o1[4];
+	__m128i vey;
+#endif
+
+	spixelw = (src->w - 1);
+	spixelh = (src->h - 1);
+	spixelgap = src->pitch/4;
+	xstep = band->flipx ? -1 : 1;
+	ystep = band->flipy ? -spixelgap : spixelgap;
+
+	for (y = band->y0; y < band->y1; y++) {
+		/*
+		* Setup source row pointers
+		*/
+		cy = (band->say[y] >> 16);
+		ey = (band->say[y] & 0xffff);
+		sp = (Uint32 *) src->pixels + spixelgap * (band->flipy ? spixelh - cy : cy);
+		/* Row below, or the same row at the bottom edge */
+		csp = (cy < spixelh) ? sp + ystep : sp;
+		dp = (tColorRGBA *) ((Uint8 *) dst->pixels + dst->pitch*y);
+
+		if (!band->smooth) {
+			/*
+			* Non-Interpolating Zoom
+			*/
+			for (x = 0; x < dst->w; x++) {
+				cx = (band->sax[x] >> 16);
+				*(Uint32 *) dp = sp[band->flipx ? spixelw - cx : cx];
+				dp++;
+			}
+			continue;
+		}
+
+		/*
+		* Interpolating Zoom
+		*/
+		x = 0;
+#ifdef USE_SSE2
+		vey = _mm_set1_epi32(ey);
+		for (; x + 4 <= dst->w; x += 4) {
+			for (i = 0; i < 4; i++) {
+				cx = (band->sax[x + i] >> 16);
+				o0[i] = band->flipx ? spixelw - cx : cx;
+				o1[i] = (cx < spixelw) ? o0[i] + xstep : o0[i];
+			}
+			_mm_storeu_si128((__m128i *) dp, _interpolateRGBA4(
+				_gatherRGBA4(sp, o0, 0), _gatherRGBA4(sp, o1, 0),
+				_gatherRGBA4(csp, o0, 0), _gatherRGBA4(csp, o1, 0),
+				_mm_loadu_si128((__m128i *) (band->sax + x)), vey));
+			dp += 4;
+		}
+#endif
+		for (; x < dst->w; x++) {
+			cx = (band->sax[x] >> 16);
+			ex = (band->sax[x] & 0xffff);
+			o = band->flipx ? spixelw - cx : cx;
+			step = (cx < spixelw) ? xstep : 0;
+			_interpolateRGBA(dp, (tColorRGBA *) (sp + o), (tColorRGBA *) (sp + o + step),
+				(tColorRGBA *) (csp + o), (tColorRGBA *) (csp + o + step), ex, ey);
+			dp++;
+		}
+	}
+}
+
 /*! 
 \brief Internal 32 bit Zoomer with optional anti-aliasing by bilinear interpolation.
 
@@ -276,10 +580,8 @@ Assumes dst surface was allocated with the correct dimensions.
 */
 int _zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy, int smooth)
 {
-	int x, y, sx, sy, ssx, ssy, *sax, *say, *csax, *csay, *salast, csx, csy, ex, ey, cx, cy, sstep, sstepx, sstepy;
-	tColorRGBA *c00, *c01, *c10, *c11;
-	tColorRGBA *sp, *csp, *dp;
-	int spixelgap, spixelw, spixelh, dgap, t1, t2;
+	int x, y, sx, sy, ssx, ssy, *sax, *say, *csax, *csay, csx, csy, spixelw, spixelh;
+	tRowBand band;
 
 	/*
 	* Allocate memory for row/column increments 
@@ -337,151 +639,20 @@ int _zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
 		}
 	}
 
-	sp = (tColorRGBA *) src->pixels;
-	dp = (tColorRGBA *) dst->pixels;
-	dgap = dst->pitch - dst->w * 4;
-	spixelgap = src->pitch/4;
-
-	if (flipx) sp += spixelw;
-	if (flipy) sp += (spixelgap * spixelh);
-
 	/*
-	* Switch between interpolating and non-interpolating code 
+	* Zoom bands of destination rows in parallel
 	*/
-	if (smooth) {
-
-		/*
-		* Interpolating Zoom 
-		*/
-		csay = say;
-		for (y = 0; y < dst->h; y++) {
-			csp = sp;
-			csax = sax;
-			for (x = 0; x < dst->w; x++) {
-				/*
-				* Setup color source pointers 
-				*/
-				ex = (*csax & 0xffff);
-				ey = (*csay & 0xffff);
-				cx = (*csax >> 16);
-				cy = (*csay >> 16);
-				sstepx = cx < spixelw;
-				sstepy = cy < spixelh;
-				c00 = sp;
-				c01 = sp;
-				c10 = sp;
-				if (sstepy) {
-					if (flipy) {
-						c10 -= spixelgap;
-					} else {
-						c10 += spixelgap;
-					}
-				}
-				c11 = c10;
-				if (sstepx) {
-					if (flipx) {
-						c01--;
-						c11--;
-					} else {
-						c01++;
-						c11++;
-					}
-				}
-
-				/*
-				* Draw and interpolate colors 
-				*/
-				t1 = ((((c01->r - c00->r) * ex) >> 16) + c00->r) & 0xff;
-				t2 = ((((c11->r - c10->r) * ex) >> 16) + c10->r) & 0xff;
-				dp->r = (((t2 - t1) * ey) >> 16) + t1;
-				t1 = ((((c01->g - c00->g) * ex) >> 16) + c00->g) & 0xff;
-				t2 = ((((c11->g - c10->g) * ex) >> 16) + c10->g) & 0xff;
-				dp->g = (((t2 - t1) * ey) >> 16) + t1;
-				t1 = ((((c01->b - c00->b) * ex) >> 16) + c00->b) & 0xff;
-				t2 = ((((c11->b - c10->b) * ex) >> 16) + c10->b) & 0xff;
-				dp->b = (((t2 - t1) * ey) >> 16) + t1;
-				t1 = ((((c01->a - c00->a) * ex) >> 16) + c00->a) & 0xff;
-				t2 = ((((c11->a - c10->a) * ex) >> 16) + c10->a) & 0xff;
-				dp->a = (((t2 - t1) * ey) >> 16) + t1;				
-				/*
-				* Advance source pointer x
-				*/
-				salast = csax;
-				csax++;				
-				sstep = (*csax >> 16) - (*salast >> 16);
-				if (flipx) {
-					sp -= sstep;
-				} else {
-					sp += sstep;
-				}
-
-				/*
-				* Advance destination pointer x
-				*/
-				dp++;
-			}
-			/*
-			* Advance source pointer y
-			*/
-			salast = csay;
-			csay++;
-			sstep = (*csay >> 16) - (*salast >> 16);
-			sstep *= spixelgap;
-			if (flipy) { 
-				sp = csp - sstep;
-			} else {
-				sp = csp + sstep;
-			}
-
-			/*
-			* Advance destination pointer y
-			*/
-			dp = (tColorRGBA *) ((Uint8 *) dp + dgap);
-		}
-	} else {
-		/*
-		* Non-Interpolating Zoom 
-		*/		
-		csay = say;
-		for (y = 0; y < dst->h; y++) {
-			csp = sp;
-			csax = sax;
-			for (x = 0; x < dst->w; x++) {
-				/*
-				* Draw 
-				*/
-				*dp = *sp;
-
-				/*
-				* Advance source pointer x
-				*/
-				salast = csax;
-				csax++;				
-				sstep = (*csax >> 16) - (*salast >> 16);
-				if (flipx) sstep = -sstep;
-				sp += sstep;
-
-				/*
-				* Advance destination pointer x
-				*/
-				dp++;
-			}
-			/*
-			* Advance source pointer y
-			*/
-			salast = csay;
-			csay++;
-			sstep = (*csay >> 16) - (*salast >> 16);
-			sstep *= spixelgap;
-			if (flipy) sstep = -sstep;			
-			sp = csp + sstep;
-
-			/*
-			* Advance destination pointer y
-			*/
-			dp = (tColorRGBA *) ((Uint8 *) dp + dgap);
-		}
-	}
+	memset(&band, 0, sizeof(band));
+	band.rows = _zoomRowsRGBA;
+	band.src = src;
+	band.dst = dst;
+	band.y1 = dst->h;
+	band.flipx = flipx;
+	band.flipy = flipy;
+	band.smooth = smooth;
+	band.sax = sax;
+	band.say = say;
+	_processRowBands(&band, dst->w * dst->h);
 
 	/*
 	* Remove temp arrays 
@@ -607,6 +778,95 @@ int _zoomSurfaceY(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy)
 	return (0);
 }
 
+/*!
+\brief Rotozooms a band of rows of a 32 bit surface.
+
+Interpolating, the pixels are located in groups of 4 and a group whose source
+pixels are all inside the source surface is interpolated at once.
+*/
+static void _transformRowsRGBA(tRowBand *band)
+{
+	SDL_Surface *src = band->src;
+	SDL_Surface *dst = band->dst;
+	int x, y, i, n, dx, dy, xd, yd, sdx, sdy, ax, ay, sw, sh, gap, o00, o01, o10, o11;
+	int o[4], ex[4], ey[4];
+	Uint32 *sp;
+	tColorRGBA *pc;
+
+	/*
+	* Variable setup 
+	*/
+	xd = ((src->w - dst->w) << 15);
+	yd = ((src->h - dst->h) << 15);
+	ax = (band->cx << 16) - (band->icos * band->cx);
+	ay = (band->cy << 16) - (band->isin * band->cx);
+	sw = src->w - 1;
+	sh = src->h - 1;
+	sp = (Uint32 *) src->pixels;
+	gap = src->pitch/4;
+
+	/* Corner offsets from the top left source pixel, swapped along the mirrored axes */
+	o00 = (band->flipx ? 1 : 0) + (band->flipy ? gap : 0);
+	o01 = (band->flipx ? 0 : 1) + (band->flipy ? gap : 0);
+	o10 = (band->flipx ? 1 : 0) + (band->flipy ? 0 : gap);
+	o11 = (band->flipx ? 0 : 1) + (band->flipy ? 0 : gap);
+
+	for (y = band->y0; y < band->y1; y++) {
+		dy = band->cy - y;
+		sdx = (ax + (band->isin * dy)) + xd;
+		sdy = (ay - (band->icos * dy)) + yd;
+		pc = (tColorRGBA *) ((Uint8 *) dst->pixels + dst->pitch*y);
+
+		if (!band->smooth) {
+			for (x = 0; x < dst->w; x++) {
+				dx = (short) (sdx >> 16);
+				dy = (short) (sdy >> 16);
+				if (band->flipx) dx = (src->w-1)-dx;
+				if (band->flipy) dy = (src->h-1)-dy;
+				if ((dx >= 0) && (dy >= 0) && (dx < src->w) && (dy < src->h)) {
+					*(Uint32 *) pc = sp[gap * dy + dx];
+				}
+				sdx += band->icos;
+				sdy += band->isin;
+				pc++;
+			}
+			continue;
+		}
+
+		for (x = 0; x < dst->w; x += n) {
+			n = (dst->w - x < 4) ? dst->w - x : 4;
+			for (i = 0; i < n; i++) {
+				dx = (sdx >> 16);
+				dy = (sdy >> 16);
+				if (band->flipx) dx = sw - dx;
+				if (band->flipy) dy = sh - dy;
+				o[i] = ((dx > -1) && (dy > -1) && (dx < sw) && (dy < sh)) ? gap * dy + dx : -1;
+				ex[i] = (sdx & 0xffff);
+				ey[i] = (sdy & 0xffff);
+				sdx += band->icos;
+				sdy += band->isin;
+			}
+#ifdef USE_SSE2
+			if (n == 4 && o[0] >= 0 && o[1] >= 0 && o[2] >= 0 && o[3] >= 0) {
+				_mm_storeu_si128((__m128i *) pc, _interpolateRGBA4(
+					_gatherRGBA4(sp, o, o00), _gatherRGBA4(sp, o, o01),
+					_gatherRGBA4(sp, o, o10), _gatherRGBA4(sp, o, o11),
+					_mm_loadu_si128((__m128i *) ex), _mm_loadu_si128((__m128i *) ey)));
+				pc += 4;
+				continue;
+			}
+#endif
+			for (i = 0; i < n; i++) {
+				if (o[i] >= 0) {
+					_interpolateRGBA(pc, (tColorRGBA *) (sp + o[i] + o00), (tColorRGBA *) (sp + o[i] + o01),
+						(tColorRGBA *) (sp + o[i] + o10), (tColorRGBA *) (sp + o[i] + o11), ex[i], ey[i]);
+				}
+				pc++;
+			}
+		}
+	}
+}
+
 /*! 
 \brief Internal 32 bit rotozoomer with optional anti-aliasing.
 
@@ -628,101 +888,24 @@ Assumes dst surface was allocated with the correct dimensions.
 */
 void _transformSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int cx, int cy, int isin, int icos, int flipx, int flipy, int smooth)
 {
-	int x, y, t1, t2, dx, dy, xd, yd, sdx, sdy, ax, ay, ex, ey, sw, sh;
-	tColorRGBA c00, c01, c10, c11, cswap;
-	tColorRGBA *pc, *sp;
-	int gap;
-
-	/*
-	* Variable setup 
-	*/
-	xd = ((src->w - dst->w) << 15);
-	yd = ((src->h - dst->h) << 15);
-	ax = (cx << 16) - (icos * cx);
-	ay = (cy << 16) - (isin * cx);
-	sw = src->w - 1;
-	sh = src->h - 1;
-	pc = (tColorRGBA*) dst->pixels;
-	gap = dst->pitch - dst->w * 4;
+	tRowBand band;
 
 	/*
-	* Switch between interpolating and non-interpolating code 
+	* Rotozoom bands of destination rows in parallel
 	*/
-	if (smooth) {
-		for (y = 0; y < dst->h; y++) {
-			dy = cy - y;
-			sdx = (ax + (isin * dy)) + xd;
-			sdy = (ay - (icos * dy)) + yd;
-			for (x = 0; x < dst->w; x++) {
-				dx = (sdx >> 16);
-				dy = (sdy >> 16);
-				if (flipx) dx = sw - dx;
-				if (flipy) dy = sh - dy;
-				if ((dx > -1) && (dy > -1) && (dx < (src->w-1)) && (dy < (src->h-1))) {
-					sp = (tColorRGBA *)src->pixels;;
-					sp += ((src->pitch/4) * dy);
-					sp += dx;
-					c00 = *sp;
-					sp += 1;
-					c01 = *sp;
-					sp += (src->pitch/4);
-					c11 = *sp;
-					sp -= 1;
-					c10 = *sp;
-					if (flipx) {
-						cswap = c00; c00=c01; c01=cswap;
-						cswap = c10; c10=c11; c11=cswap;
-					}
-					if (flipy) {
-						cswap = c00; c00=c10; c10=cswap;
-						cswap = c01; c01=c11; c11=cswap;
-					}
-					/*
-					* Interpolate colors 
-					*/
-					ex = (sdx & 0xffff);
-					ey = (sdy & 0xffff);
-					t1 = ((((c01.r - c00.r) * ex) >> 16) + c00.r) & 0xff;
-					t2 = ((((c11.r - c10.r) * ex) >> 16) + c10.r) & 0xff;
-					pc->r = (((t2 - t1) * ey) >> 16) + t1;
-					t1 = ((((c01.g - c00.g) * ex) >> 16) + c00.g) & 0xff;
-					t2 = ((((c11.g - c10.g) * ex) >> 16) + c10.g) & 0xff;
-					pc->g = (((t2 - t1) * ey) >> 16) + t1;
-					t1 = ((((c01.b - c00.b) * ex) >> 16) + c00.b) & 0xff;
-					t2 = ((((c11.b - c10.b) * ex) >> 16) + c10.b) & 0xff;
-					pc->b = (((t2 - t1) * ey) >> 16) + t1;
-					t1 = ((((c01.a - c00.a) * ex) >> 16) + c00.a) & 0xff;
-					t2 = ((((c11.a - c10.a) * ex) >> 16) + c10.a) & 0xff;
-					pc->a = (((t2 - t1) * ey) >> 16) + t1;
-				}
-				sdx += icos;
-				sdy += isin;
-				pc++;
-			}
-			pc = (tColorRGBA *) ((Uint8 *) pc + gap);
-		}
-	} else {
-		for (y = 0; y < dst->h; y++) {
-			dy = cy - y;
-			sdx = (ax + (isin * dy)) + xd;
-			sdy = (ay - (icos * dy)) + yd;
-			for (x = 0; x < dst->w; x++) {
-				dx = (short) (sdx >> 16);
-				dy = (short) (sdy >> 16);
-				if (flipx) dx = (src->w-1)-dx;
-				if (flipy) dy = (src->h-1)-dy;
-				if ((dx >= 0) && (dy >= 0) && (dx < src->w) && (dy < src->h)) {
-					sp = (tColorRGBA *) ((Uint8 *) src->pixels + src->pitch * dy);
-					sp += dx;
-					*pc = *sp;
-				}
-				sdx += icos;
-				sdy += isin;
-				pc++;
-			}
-			pc = (tColorRGBA *) ((Uint8 *) pc + gap);
-		}
-	}
+	memset(&band, 0, sizeof(band));
+	band.rows = _transformRowsRGBA;
+	band.src = src;
+	band.dst = dst;
+	band.y1 = dst->h;
+	band.cx = cx;
+	band.cy = cy;
+	band.isin = isin;
+	band.icos = icos;
+	band.flipx = flipx;
+	band.flipy = flipy;
+	band.smooth = smooth;
+	_processRowBands(&band, dst->w * dst->h);
 }
 
 /*!
@@ -0,0 +1,231 @@
+#include "pointmarching.h"
+
+/* -------------------------
+ *        Headless
+ * -------------------------
+*/
+
+// Runs the marching core without a window, renderer or keyboard. The player light follows a
+// scripted path for a fixed number of frames, every frame is filled into the software
+// framebuffer and can be written out as a PPM. The scene seed and the frame clock are fixed,
+// so runs are repeatable and the frame times are comparable between builds and machines. The
+// flags, listed by print_usage, switch on what the window switches with its keys. Pipelined
+// (-p) the output is the same, but every frame leaves the pipeline one step later.
+
+#define HEADLESS_DEFAULT_FRAMES 600
+#define HEADLESS_DEFAULT_SEED 1
+#define HEADLESS_FRAME_TIME (1 / 60.0)
+#define HEADLESS_PATH_RADIUS_X 250
+#define HEADLESS_PATH_RADIUS_Y 180
+
+// the player light traces a Lissajous figure around the middle of the world
+vec2 light_path(double time) {
+    return vec2{ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }
+        + vec2{ cosf(time * 0.7f) * HEADLESS_PATH_RADIUS_X, sinf(time * 1.1f) * HEADLESS_PATH_RADIUS_Y };
+}
+
+void print_usage(const char *name) {
+    printf("usage: %s [-n frames] [-s seed] [-o prefix] [-e] [-p] [-f cache|exact|error] [-b ms] [-l lights] [-q ms] [-t threads] [-a] [-m] [-v march|polar]\n", name);
+    printf("  -n frames  number of frames to run (default %d)\n", HEADLESS_DEFAULT_FRAMES);
+    printf("  -s seed    seed for the scattered circles (default %d)\n", HEADLESS_DEFAULT_SEED);
+    printf("  -o prefix  write every frame to <prefix><frame>.ppm\n");
+    printf("  -e         march against the exact distances instead of the cache\n");
+    printf("  -p         march the next frame while the current one is filled\n");
+    printf("  -f field   draw the cached or exact distance field, or the error of the cache\n");
+    printf("  -b ms      lower the resolution to hold a frame time budget\n");
+    printf("  -l lights  number of lights, the first follows the path (default 1)\n");
+    printf("  -q ms      thin out the rays to hold a march time budget\n");
+    printf("  -t threads light queue workers besides the main thread (default one per extra core)\n");
+    printf("  -a         area lights with soft shadows instead of point lights\n");
+    printf("  -m         shade every pixel from the shadow maps instead of filling the outlines\n");
+    printf("  -v engine  find the visibility by marching the rays or resampling the field in polar coordinates\n");
+}
+
+int main(int argc, char **argv) {
+    int frames { HEADLESS_DEFAULT_FRAMES };
+    unsigned int seed { HEADLESS_DEFAULT_SEED };
+    const char *ppmPrefix { nullptr };
+    bool exact { false };
+    bool pipelined { false };
+    bool field { false };
+    double budget { 0 };
+    int lightCount { 1 };
+    double marchBudget { 0 };
+    // -1 for one per extra core
+    int lightThreads { -1 };
+    bool areaLights { false };
+    bool shaded { false };
+    FieldSource fieldSource { FIELD_SOURCE_CACHE };
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            ppmPrefix = argv[++i];
+        } else if (!strcmp(argv[i], "-e")) {
+            exact = true;
+        } else if (!strcmp(argv[i], "-p")) {
+            pipelined = true;
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            budget = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            lightCount = std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+            marchBudget = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            lightThreads = std::max(atoi(argv[++i]), 0);
+        } else if (!strcmp(argv[i], "-a")) {
+            areaLights = true;
+        } else if (!strcmp(argv[i], "-m")) {
+            shaded = true;
+        } else if (!strcmp(argv[i], "-v") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "march")) {
+                visibilityEngine = VISIBILITY_MARCH;
+            } else if (!strcmp(argv[i], "polar")) {
+                visibilityEngine = VISIBILITY_POLAR;
+            } else {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            field = true;
+            i++;
+            if (!strcmp(argv[i], "cache")) {
+                fieldSource = FIELD_SOURCE_CACHE;
+            } else if (!strcmp(argv[i], "exact")) {
+                fieldSource = FIELD_SOURCE_EXACT;
+            } else if (!strcmp(argv[i], "error")) {
+                fieldSource = FIELD_SOURCE_ERROR;
+            } else {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    init_framebuffer(framebuffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+    create_drawables(seed);
+    create_lights(lightCount);
+    if (areaLights)
+        for (auto l : lights)
+            l->penumbra = LIGHT_AREA_PENUMBRA;
+    create_light_directions();
+    create_dynamic_drawables();
+    Drawable *player = lights.front();
+
+    // wait for the first cache, frames marching exactly in the meantime would skew the timings
+    if (!exact) {
+        start_pm_cache_builder();
+        request_pm_cache_rebuild();
+        while (!acquire_pm_cache())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // the field view has no march stage to overlap with
+    if (field)
+        pipelined = false;
+    if (lightThreads != 0)
+        start_light_queue(std::max(lightThreads, 0));
+    if (pipelined)
+        start_frame_pipeline();
+    else if (field)
+        start_field_view();
+
+    if (budget > 0)
+        resolutionGovernor.budget = budget;
+    if (marchBudget > 0) {
+        qualityGovernor.budget = marchBudget;
+        qualityGovernor.enabled = true;
+    }
+
+    std::vector<double> frameTimes;
+    double marchTotal { 0 };
+    size_t rayTotal { 0 };
+    int result { EXIT_SUCCESS };
+    FrameTrace sequentialTrace;
+    FrameTrace *trace { nullptr };
+    // pipelined, one more iteration drains the frame still in the pipeline
+    for (int frame = 0; frame < frames + (pipelined ? 1 : 0); frame++) {
+        double time { frame * HEADLESS_FRAME_TIME };
+        auto start = std::chrono::steady_clock::now();
+
+        if (frame < frames) {
+            player->pos = light_path(time);
+            move_dynamic_drawables(time);
+            if (field) {
+                draw_field(framebuffer, exact ? nullptr : acquire_pm_cache(), camera, fieldSource, resolutionGovernor.scale);
+            } else if (pipelined) {
+                submit_frame_trace(exact ? nullptr : acquire_pm_cache(), camera, false);
+            } else {
+                trace_frame(sequentialTrace, exact ? nullptr : acquire_pm_cache(), camera, false);
+                trace = &sequentialTrace;
+            }
+        }
+        // the first pipelined iteration has nothing to fill yet, the worker marches meanwhile
+        FrameTrace *filling { trace };
+        if (filling) {
+            marchTotal += filling->marchMs;
+            rayTotal += filling->rays;
+            if (shaded)
+                shade_frame(framebuffer, *filling, resolutionGovernor.scale);
+            else
+                fill_frame(framebuffer, *filling, resolutionGovernor.scale);
+        }
+        // the scene must not move again before the submitted frame is marched
+        if (pipelined)
+            trace = frame < frames ? wait_frame_trace() : nullptr;
+        if (!filling && !field)
+            continue;
+        int filled { pipelined ? frame - 1 : frame };
+
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        if (ppmPrefix) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s%05d.ppm", ppmPrefix, filled);
+            if (!fb_write_ppm(framebuffer, path)) {
+                printf("could not write %s\n", path);
+                result = EXIT_FAILURE;
+                break;
+            }
+        }
+
+        // the next frame is filled at the new resolution
+        if (budget > 0 && update_resolution_governor(resolutionGovernor, frameTimes.back()))
+            init_framebuffer(framebuffer, scaled_size(WINDOW_WIDTH, resolutionGovernor.scale),
+                scaled_size(WINDOW_HEIGHT, resolutionGovernor.scale));
+    }
+
+    if (!frameTimes.empty()) {
+        double total { 0 };
+        for (double t : frameTimes)
+            total += t;
+        std::sort(frameTimes.begin(), frameTimes.end());
+        printf("%zu frames in %.1f ms, mean %.3f ms, median %.3f ms, min %.3f ms, max %.3f ms\n",
+            frameTimes.size(), total, total / frameTimes.size(), frameTimes[frameTimes.size() / 2],
+            frameTimes.front(), frameTimes.back());
+        if (!field)
+            printf("march stage mean %.3f ms, %zu rays per frame\n", marchTotal / frameTimes.size(), rayTotal / frameTimes.size());
+        if (budget > 0)
+            printf("resolution settled at %d%% for a budget of %.3f ms\n", static_cast<int>(resolutionGovernor.scale * 100), budget);
+    }
+
+    if (pipelined) {
+        wait_frame_trace();
+        stop_frame_pipeline();
+    }
+    if (field)
+        stop_field_view();
+    stop_light_queue();
+    if (!exact)
+        stop_pm_cache_builder();
+    destroy_drawables();
+    destroy_dynamic_drawables();
+    destroy_lights();
+    return result;
+}
@@ -1,143 +1,68 @@
-#include <math.h>
-#include <stdio.h>
-#include <ctime>
-#include <vector>
-#include <random>
-#include <array>
-#include <algorithm>
-#include <stdexcept>
-
-#define PI 3.14159265
-#define MAX(x, y) (((x) > (y)) ? (x) : (y))
-#define MIN(x, y) (((x) < (y)) ? (x) : (y))
-
-float clip(float n, float lower, float upper) {
-    return std::max(lower, std::min(n, upper));
-}
+#include "pointmarching.h"
 
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 
 #include <SDL2_gfxPrimitives.h>
-
-typedef struct vec2 {
-    float x, y;
-
-    vec2() : x{0}, y{0} {}
-    vec2(float x, float y) : x{x}, y{y} {}
-    vec2 operator+ (vec2 o) {
-        return { x + o.x, y + o.y };
-    }
-    vec2 operator- (vec2 o) {
-        return { x - o.x, y - o.y };
-    }
-    float operator* (vec2 o) {
-        return x * o.x + y * o.y;
-    }
-    vec2 operator* (float v) {
-        return { x * v, y * v };
-    }
-    vec2 operator/ (float v) {
-        return { x / v, y / v };
-    }
-    float magnitude() {
-        return sqrt(*this * *this);
-    }
-    float sqr_mag() {
-        return *this * *this;
-    }
-    vec2 normalized() {
-        if (*this * *this == 1)
-            return *this;
-        else
-            return *this / magnitude();
-    }
-    void normalize() {
-        if (*this * *this == 1)
-            return;
-        *this = *this / magnitude();
-    }
-    vec2 abs() {
-        return { std::abs(x), std::abs(y) };
-    }
-    float max() {
-        return std::max(x, y);
-    }
-    float min() {
-        return std::min(x, y);
-    }
-    static vec2 max(vec2 a, vec2 b) {
-        return { std::max(a.x, b.x), std::max(a.y, b.y) };
-    }
-} vec2;
-
-class Drawable {
-public:
-    vec2 pos;
-    virtual float sdf(vec2 p) {
-        return 0;
-    }
-    Drawable(vec2 pos) : pos{ pos } {}
-    ~Drawable() {}
-};
-
-class Circle : public Drawable {
-public:
-    float radius;
-    float sdf(vec2 p) override {
-        return (pos - p).magnitude() - radius;
-    }
-    Circle(vec2 pos, float radius) : Drawable{ pos }, radius{ radius } {}
-};
-
-class Rectangle : public Drawable {
-public:
-    vec2 size;
-    float sdf(vec2 p) override {
-        p = pos - p;
-        vec2 d = p.abs() - size / 2;
-        return vec2::max(d, { 0,0 }).magnitude() + std::min(std::max(d.x,d.y),0.f);
-    }
-    Rectangle(vec2 pos, vec2 size) : Drawable{ pos }, size{ size } {}
-};
-
-class Light : public Drawable {
-public:
-    float brightness;
-    float sdf(vec2 p) override {
-        return (pos - p).magnitude();
-    }
-    Light(vec2 pos, float brightness) : Drawable{ pos }, brightness{ brightness } {}
-};
-
+#include <SDL2_rotozoom.h>
 
 /* -------------------------
  *      Rendering Stuff
  * -------------------------
 */
 
-#define WINDOW_WIDTH 800
-#define WINDOW_HEIGHT 600
-
-#define DEF_COL_R 0
-#define DEF_COL_G 0
-#define DEF_COL_B 0
-#define DEF_COL_A 255
-
-#define DEF_BG_COL_R 255
-#define DEF_BG_COL_G 150
-#define DEF_BG_COL_B 31
-#define DEF_BG_COL_A 255
-
 SDL_Event event;
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+// debug points are collected over the frame and drawn with one SDL_RenderDrawPoints call per
+// run of points queued in the same draw colour and blend mode, the buffer keeps its capacity
+// between frames
+struct PointBatch {
+    // draw state of the renderer when the points were queued
+    SDL_Color color;
+    SDL_BlendMode blendMode;
+    std::vector<SDL_Point> points;
+};
+PointBatch pointBatch;
+
+// draws the queued points in the state they were queued in and leaves the renderer's state as it was
+void flush_points() {
+    if (pointBatch.points.empty())
+        return;
+    SDL_Color color;
+    SDL_BlendMode blendMode;
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
+    SDL_GetRenderDrawBlendMode(renderer, &blendMode);
+    SDL_SetRenderDrawBlendMode(renderer, pointBatch.blendMode);
+    SDL_SetRenderDrawColor(renderer, pointBatch.color.r, pointBatch.color.g, pointBatch.color.b, pointBatch.color.a);
+    SDL_RenderDrawPoints(renderer, pointBatch.points.data(), pointBatch.points.size());
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_SetRenderDrawBlendMode(renderer, blendMode);
+    pointBatch.points.clear();
+}
+
+// the points queued next use the renderer's current draw state, the ones before it are
+// flushed if that changed
+void begin_points() {
+    SDL_Color color;
+    SDL_BlendMode blendMode;
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
+    SDL_GetRenderDrawBlendMode(renderer, &blendMode);
+    if (!pointBatch.points.empty() && (color.r != pointBatch.color.r || color.g != pointBatch.color.g
+        || color.b != pointBatch.color.b || color.a != pointBatch.color.a || blendMode != pointBatch.blendMode))
+        flush_points();
+    pointBatch.color = color;
+    pointBatch.blendMode = blendMode;
+}
+
 void draw_pixel(vec2 pos) {
-    SDL_RenderDrawPoint(renderer, pos.x, pos.y);
+    begin_points();
+    pointBatch.points.push_back({ static_cast<int>(pos.x), static_cast<int>(pos.y) });
 }
 void draw_circle(int32_t centreX, int32_t centreY, int32_t radius)
 {
+   begin_points();
    const int32_t diameter = (radius * 2);
 
    int32_t x = (radius - 1);
@@ -149,14 +74,14 @@ void draw_circle(int32_t centreX, int32_t centreY, int32_t radius)
    while (x >= y)
    {
       //  Each of the following renders an octant of the circle
-      SDL_RenderDrawPoint(renderer, centreX + x, centreY - y);
-      SDL_RenderDrawPoint(renderer, centreX + x, centreY + y);
-      SDL_RenderDrawPoint(renderer, centreX - x, centreY - y);
-      SDL_RenderDrawPoint(renderer, centreX - x, centreY + y);
-      SDL_RenderDrawPoint(renderer, centreX + y, centreY - x);
-      SDL_RenderDrawPoint(renderer, centreX + y, centreY + x);
-      SDL_RenderDrawPoint(renderer, centreX - y, centreY - x);
-      SDL_RenderDrawPoint(renderer, centreX - y, centreY + x);
+      pointBatch.points.push_back({ centreX + x, centreY - y });
+      pointBatch.points.push_back({ centreX + x, centreY + y });
+      pointBatch.points.push_back({ centreX - x, centreY - y });
+      pointBatch.points.push_back({ centreX - x, centreY + y });
+      pointBatch.points.push_back({ centreX + y, centreY - x });
+      pointBatch.points.push_back({ centreX + y, centreY + x });
+      pointBatch.points.push_back({ centreX - y, centreY - x });
+      pointBatch.points.push_back({ centreX - y, centreY + x });
 
       if (error <= 0)
       {
@@ -175,48 +100,91 @@ void draw_circle(int32_t centreX, int32_t centreY, int32_t radius)
 }
 
 /* -------------------------
- *       Drawable Stuff
+ *    Software Rendering
  * -------------------------
 */
 
-#define RANDOM_CIRCLE_COUNT 50
-#define RANDOM_CIRCLE_MIN_SIZE 10
-#define RANDOM_CIRCLE_MAX_SIZE 30
+// The core fills the framebuffer, it is uploaded once per frame through a streaming texture.
+
+enum RenderMode {
+    RENDER_MODE_GFX,
+    RENDER_MODE_SOFTWARE,
+    // light regions as one triangle fan per light with per vertex falloff
+    RENDER_MODE_GEOMETRY,
+    // the distance field instead of the lights, see fieldSource
+    RENDER_MODE_FIELD,
+    // every pixel shaded against the lights' shadow maps instead of filling their outlines
+    RENDER_MODE_SHADED
+};
+RenderMode renderMode { RENDER_MODE_SOFTWARE };
+FieldSource fieldSource { FIELD_SOURCE_CACHE };
+
+// Under load the resolution governor shrinks the framebuffer, the framebuffer modes fill it at
+// its scale and it is stretched over the window when presented. The gfx and geometry modes
+// draw through the renderer at full resolution.
+enum UpscaleMode {
+    // linear filtering of the renderer while copying the texture to the window
+    UPSCALE_RENDERER,
+    // smooth zoomSurface on the CPU before the upload
+    UPSCALE_ZOOM_SURFACE
+};
+UpscaleMode upscaleMode { UPSCALE_RENDERER };
+bool governResolution { true };
 
-std::vector<Drawable*> drawables;
-void create_drawables() {
-    srand(time(0));
+SDL_Texture *framebufferTexture;
 
-    for (int i = 0; i < RANDOM_CIRCLE_COUNT; i++) {
-        int radius = rand() % (RANDOM_CIRCLE_MAX_SIZE - RANDOM_CIRCLE_MIN_SIZE) + RANDOM_CIRCLE_MIN_SIZE;
-        vec2 pos = { rand() % (WINDOW_WIDTH - 2 * radius) + radius, rand() % (WINDOW_HEIGHT - 2 * radius) + radius };
-        drawables.emplace_back(new Circle{ pos, radius });
-    }
-    
-    drawables.emplace_back(new Rectangle{ {WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2}, {200, 100} });
+void create_framebuffer(int width, int height) {
+    init_framebuffer(framebuffer, width, height);
+    // the texture keeps the window size, a scaled down buffer only uses its top left
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    framebufferTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
 }
-void destroy_drawables() {
-    for (auto d : drawables)
-        delete d;
+void destroy_framebuffer() {
+    SDL_DestroyTexture(framebufferTexture);
 }
 
-float get_min_dist(vec2 pos, Drawable **drawable) {
-    float min { 10000.f };
-    for (auto d : drawables) {
-        float newDist { d->sdf(pos) };
-        if (newDist < min) {
-            min = newDist;
-            *drawable = d;
-            if (min <= 0) {
-                break;
-            }
+// resizes the framebuffer to the governor's scale, nothing happens while it matches
+void apply_resolution_scale() {
+    int width { scaled_size(WINDOW_WIDTH, resolutionGovernor.scale) };
+    int height { scaled_size(WINDOW_HEIGHT, resolutionGovernor.scale) };
+    if (framebuffer.width != width || framebuffer.height != height)
+        init_framebuffer(framebuffer, width, height);
+}
+
+// copies the buffer into the streaming texture and stretches it over the whole window
+void fb_present(Framebuffer &fb) {
+    const uint8_t *src { reinterpret_cast<const uint8_t*>(fb.pixels.data()) };
+    int width { fb.width };
+    int height { fb.height };
+    int srcPitch { fb.width * static_cast<int>(sizeof(uint32_t)) };
+    SDL_Surface *zoomed { nullptr };
+    if (upscaleMode == UPSCALE_ZOOM_SURFACE && (fb.width != WINDOW_WIDTH || fb.height != WINDOW_HEIGHT)) {
+        SDL_Surface *scaled = SDL_CreateRGBSurfaceFrom(fb.pixels.data(), fb.width, fb.height, 32, srcPitch,
+            0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+        if (scaled) {
+            zoomed = zoomSurface(scaled, static_cast<double>(WINDOW_WIDTH) / fb.width, static_cast<double>(WINDOW_HEIGHT) / fb.height, SMOOTHING_ON);
+            SDL_FreeSurface(scaled);
+        }
+        // zoomSurface rounds the size, it may be a pixel off the window
+        if (zoomed) {
+            src = static_cast<const uint8_t*>(zoomed->pixels);
+            width = std::min(zoomed->w, WINDOW_WIDTH);
+            height = std::min(zoomed->h, WINDOW_HEIGHT);
+            srcPitch = zoomed->pitch;
         }
     }
-    return min;
-}
 
-float get_min_dist(vec2 pos) {
-    return get_min_dist(pos, nullptr);
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(framebufferTexture, nullptr, &pixels, &pitch) == 0) {
+        for (int y = 0; y < height; y++)
+            memcpy(static_cast<uint8_t*>(pixels) + static_cast<size_t>(y) * pitch, src + static_cast<size_t>(y) * srcPitch, width * sizeof(uint32_t));
+        SDL_UnlockTexture(framebufferTexture);
+        SDL_Rect source { 0, 0, width, height };
+        SDL_RenderCopy(renderer, framebufferTexture, &source, nullptr);
+    }
+    if (zoomed)
+        SDL_FreeSurface(zoomed);
 }
 
 /* -------------------------
@@ -224,300 +192,288 @@ float get_min_dist(vec2 pos) {
  * -------------------------
 */
 
-#define LIGHT_RAY_MAX_DEPTH 50
-
-std::vector<Light*> lights;
-void create_lights() {
-    lights.emplace_back(new Light({ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }, 100.f));
+// A light's visible region is star shaped around it, so it is exactly a triangle fan around
+// the light. The whole fan goes to the renderer in one SDL_RenderGeometry call and the vertex
+// colours interpolate into a radial falloff.
+struct LightFan {
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+} lightFan;
+
+void begin_light_fan(vec2 centre) {
+    lightFan.vertices.clear();
+    lightFan.vertices.push_back({ { centre.x, centre.y }, { 255, 255, 255, 255 }, { 0, 0 } });
 }
-#define LIGHT_DIR_COUNT 3600
-vec2 light_directions[LIGHT_DIR_COUNT];
-
-typedef struct RayHitInfo {
-    vec2 pos;
-    Drawable* drawable;
-    float distance;
-    bool hit;
-} RayHitInfo;
-
-bool march_ray(vec2 pos, vec2 delta, RayHitInfo* hit, float maxDepth = 100.f, float threshold = 0.01f, uint16_t maxSteps = 50) {
-    float min;
-    int depth { 0 };
-    delta.normalize();
-    hit->hit = false;
-    do {
-        min = get_min_dist(pos, &hit->drawable);
-        if (min <= threshold) {
-            hit->hit = true;
-            break;
-        }
-        pos = pos + delta * min;
-        hit->distance += min;
-        depth++;
-    } while (depth < maxSteps && clip(pos.x, 0, WINDOW_WIDTH) == pos.x && clip(pos.y, 0, WINDOW_HEIGHT) == pos.y && min >= threshold);
-    hit->pos = pos;
-    return hit->hit;
-}
-
-float interpolate(float a, float b, float t) {
-    return a * (1 - t) + b * t;
-}
-float four_point_ip(float a, float b, float c, float d, vec2 delta, vec2 pointDelta) {
-    return interpolate(
-        interpolate(a, b, delta.x / pointDelta.x),
-        interpolate(d, c, delta.x / pointDelta.x),
-        delta.y / pointDelta.y
-    );
-}
-vec2 abs_point_around(vec2 pos, int index) {
-    switch(index) {
-        case 0:
-            return vec2( floorf(pos.x), floorf(pos.y) );
-        case 1:
-            return vec2( ceilf (pos.x), floorf(pos.y) );
-        case 2:
-            return vec2( ceilf (pos.x), ceilf (pos.y) );
-        case 3:
-            return vec2( floorf(pos.x), ceilf (pos.y) );
-        default:
-            return {};
-    }
-}
-
-#define PM_CACHE_PRECISION 1
-#define PM_CACHE_WIDTH PM_CACHE_PRECISION * WINDOW_WIDTH
-#define PM_CACHE_HEIGHT PM_CACHE_PRECISION * WINDOW_HEIGHT
-#define PM_CACHE_SIZE PM_CACHE_HEIGHT * PM_CACHE_WIDTH
-
-uint64_t get_pm_index(vec2 pos) {
-    return static_cast<uint64_t>(pos.x + pos.y * PM_CACHE_WIDTH);
+void push_light_fan_point(vec2 screen, float intensity) {
+    lightFan.vertices.push_back({ { screen.x, screen.y }, { 255, 255, 255, static_cast<uint8_t>(intensity * 255) }, { 0, 0 } });
 }
-
-float pointmarchingCache[PM_CACHE_SIZE];
-Drawable *pointmarchingDrawableCache[PM_CACHE_SIZE];
-float pm_cache(vec2 pos) {
-    pos = pos * PM_CACHE_PRECISION;
-    if (clip(pos.x, 0, PM_CACHE_WIDTH - 1) != pos.x || clip(pos.y, 0, PM_CACHE_HEIGHT - 1) != pos.y) {
-        printf("\ncache out of bounds: %f %f\n", pos.x, pos.y);
-        fflush(stdout);
-        throw std::runtime_error("cache out of bounds");
+// closed fans wrap around the light, open ones are the wedge of a light outside the view
+void draw_light_fan(bool closed) {
+    auto &vertices = lightFan.vertices;
+    auto &indices = lightFan.indices;
+    int n = vertices.size();
+    indices.clear();
+    for (int i = 1; i + 1 < n; i++) {
+        indices.push_back(0);
+        indices.push_back(i);
+        indices.push_back(i + 1);
     }
-
-    // return pointmarchingCache[static_cast<int64_t>(pos.x + pos.y * PM_CACHE_WIDTH)];
-    float a = pointmarchingCache[get_pm_index( { floor(pos.x), floor(pos.y)} )];
-    float b = pointmarchingCache[get_pm_index( { ceil (pos.x), floor(pos.y)} )];
-    float c = pointmarchingCache[get_pm_index( { ceil (pos.x), ceil (pos.y)} )];
-    float d = pointmarchingCache[get_pm_index( { floor(pos.x), ceil (pos.y)} )];
-    vec2 origin = { floor(pos.x), floor(pos.y) };
-    vec2 delta = pos - origin;
-    float pointDelta = { 1.f / PM_CACHE_PRECISION };
-    return four_point_ip(a, b, c, d, delta, { pointDelta, pointDelta });
-}
-Drawable* pm_d_cache(vec2 pos) {
-    pos = pos * PM_CACHE_PRECISION;
-
-    // std::array<float, 4> all;
-    // int nearest = 0;
-    // for (int i = 0; i < 4; i++) {
-    //     all[i] = (pos - abs_point_around(pos, i)).sqr_mag();
-    //     for (int j = 0; j < i; j++) {
-    //         if (all[i] < all[j]) {
-    //             nearest = i;
-    //         }
-    //     }
-    // }
-
-    return pointmarchingDrawableCache[get_pm_index(abs_point_around(pos, 0))];
-}
-float& direct_pm_cache(vec2 pos) {
-    return pointmarchingCache[get_pm_index(pos)];
-}
-Drawable** direct_pm_d_cache(vec2 pos) {
-    return pointmarchingDrawableCache + get_pm_index(pos);
-}
-void precalc_pm_cache() {
-    vec2 it;
-    Drawable* d;
-    for (it.x = 0; it.x < PM_CACHE_WIDTH; it.x++) {
-        fflush(stdout);
-        for (it.y = 0; it.y < PM_CACHE_HEIGHT; it.y++) {
-            direct_pm_cache(it) = get_min_dist(it / PM_CACHE_PRECISION, &d);
-            *direct_pm_d_cache(it) = d;
-        }
-        printf("\rto a percentage of %.2f done", it.x / static_cast<float>(PM_CACHE_WIDTH));
+    if (closed && n > 2) {
+        indices.push_back(0);
+        indices.push_back(n - 1);
+        indices.push_back(1);
     }
-    printf("\n");
-}
-
-bool march_ray_cache(vec2 pos, vec2 delta, RayHitInfo* hit, float maxDepth = 100.f, float threshold = 0.01f, uint16_t maxSteps = 50) {
-    float min;
-    int depth { 0 };
-    delta.normalize();
-    hit->hit = false;
-    do {
-        min = pm_cache(pos);
-        if (min <= 1.5f / PM_CACHE_PRECISION) {
-            min = pm_d_cache(pos)->sdf(pos);
-            // min = get_min_dist(pos);
-        }
-        if (min <= threshold) {
-            hit->hit = true;
-            break;
-        }
-        pos = pos + delta * min;
-        hit->distance += min;
-        depth++;
-    } while (depth < maxSteps && clip(pos.x, 0, WINDOW_WIDTH - 1) == pos.x && clip(pos.y, 0, WINDOW_HEIGHT - 1) == pos.y && min >= threshold);
-    hit->pos = pos;
-    return hit->hit;
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_RenderGeometry(renderer, nullptr, vertices.data(), n, indices.data(), indices.size());
+#else
+    // no geometry api before SDL 2.0.18, fill the outline without falloff instead
+    Polygon polygon;
+    for (size_t i = closed ? 1 : 0; i < vertices.size(); i++)
+        push_polygon_point(polygon, { vertices[i].position.x, vertices[i].position.y });
+    filledPolygonRGBA(renderer, polygon.posX.data(), polygon.posY.data(), polygon.posX.size(), 255, 255, 255, 255);
+#endif
 }
 
-vec2 march_ray_light(vec2 pos, vec2 delta, float threshold = 0.01f) {
-    float min;
-    int depth { 0 };
-    do {
-        min = get_min_dist(pos);
-        if (min <= threshold) {
-            break;
-        }
-        pos = pos + delta.normalized() * min;
-        depth++;
-    } while (depth < LIGHT_RAY_MAX_DEPTH && clip(pos.x, 0, WINDOW_WIDTH) == pos.x && clip(pos.y, 0, WINDOW_HEIGHT) == pos.y && min >= threshold);
-    //SDL_RenderDrawLine(renderer, (pos.x > WINDOW_WIDTH) ? WINDOW_WIDTH : pos.x, (pos.y > WINDOW_HEIGHT) ? WINDOW_HEIGHT : pos.y, origin.x, origin.y);
-    return pos;
-}
-
-struct Polygon {
-    std::vector<int16_t> posX;
-    std::vector<int16_t> posY;
-};
-
 double deltaTimeD;
-void draw() {
-    // point marching for each pixel on the screen
-    /*
-    vec2 it;
-    for (it.x = 0; it.x <= WINDOW_WIDTH; it.x++) {
-        for (it.y = 0; it.y <= WINDOW_HEIGHT; it.y++) {
-            float min = 10000;
-            for (auto d : drawables) {
-                float newDist = d->sdf(it);
-                if (newDist < min) {
-                    min = newDist;
-                    if (min <= 0)
-                        break;
-                }
-            }
-            if (min <= 0) {
-                draw_pixel(it);
-            }
-        }
-    }
-    */
-
+void draw(const FrameTrace &frame) {
     // displaying the circles
     //for (auto d : drawables) {
     //    filledCircleRGBA(renderer, d->pos.x, d->pos.y, static_cast<Circle*>(d)->radius, 0, 0, 0, 255);
     //}
 
-    // ray marching for each light
+    // the lights were marched by the march stage, only their outlines are filled here
+    if (renderMode == RENDER_MODE_SOFTWARE) {
+        fill_frame(framebuffer, frame, resolutionGovernor.scale);
+        return;
+    }
+    if (renderMode == RENDER_MODE_SHADED) {
+        shade_frame(framebuffer, frame, resolutionGovernor.scale);
+        return;
+    }
+
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    for (auto l : lights) {
-        std::vector<Polygon> polygons { 1 };
-        
-        for (int i = 0; i < LIGHT_DIR_COUNT; i++) {
-            RayHitInfo hit;
-            march_ray_cache(l->pos, light_directions[i], &hit);
-            
-            polygons.back().posX.push_back(hit.pos.x);
-            polygons.back().posY.push_back(hit.pos.y);
-
-            //SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-            //SDL_RenderDrawPoint(renderer, hit.pos.x, hit.pos.y);
-        }
-        for (auto p : polygons) {
-            filledPolygonRGBA(renderer, p.posX.data(), p.posY.data(), p.posX.size(), 255, 255, 255, 255);
+    // the gfx fills only submit their spans when the color changes or the frame's batch ends
+    if (!frame.fan)
+        gfxPrimitivesBeginSpans(renderer);
+    Polygon polygon;
+    for (size_t i = 0; i < frame.count; i++) {
+        const LightOutline &outline = frame.lights[i];
+        if (frame.fan) {
+            begin_light_fan(outline.screenPos);
+            for (size_t k = 0; k < outline.points.size(); k++)
+                push_light_fan_point(outline.points[k], outline.values[k]);
+            draw_light_fan(outline.closed);
+        } else {
+            polygon.posX.clear();
+            polygon.posY.clear();
+            for (auto point : outline.points)
+                push_polygon_point(polygon, point);
+            filledPolygonRGBA(renderer, polygon.posX.data(), polygon.posY.data(), polygon.posX.size(), 255, 255, 255, 255);
         }
-        filledCircleRGBA(renderer, l->pos.x, l->pos.y, 10, 0, 255, 0, 255);
+        if (outline.inView)
+            filledCircleRGBA(renderer, outline.screenPos.x, outline.screenPos.y, 10, 0, 255, 0, 255);
     }
+    if (!frame.fan)
+        gfxPrimitivesEndSpans(renderer);
 }
 
 #define PLAYER_SPEED 70
+bool quitRequested { false };
+bool pipelineFrames { true };
 void move_player(Drawable *player) {
     SDL_PumpEvents();
     auto keyboard = SDL_GetKeyboardState(NULL);
     
+    vec2 move;
     if (keyboard[SDL_SCANCODE_W] == SDL_PRESSED)
-        player->pos.y -= PLAYER_SPEED * deltaTimeD;
+        move.y -= 1;
     if (keyboard[SDL_SCANCODE_S] == SDL_PRESSED)
-        player->pos.y += PLAYER_SPEED * deltaTimeD;
+        move.y += 1;
     if (keyboard[SDL_SCANCODE_D] == SDL_PRESSED)
-        player->pos.x += PLAYER_SPEED * deltaTimeD;
+        move.x += 1;
     if (keyboard[SDL_SCANCODE_A] == SDL_PRESSED)
-        player->pos.x -= PLAYER_SPEED * deltaTimeD;
+        move.x -= 1;
+    player->pos = player->pos + move * (PLAYER_SPEED * deltaTimeD);
+    // get the chunks ahead of the player built before the rays reach them
+    if (move.x != 0 || move.y != 0)
+        request_pm_cache_prefetch(player->pos + move.normalized() * PM_PREFETCH_DISTANCE);
         
+    // camera pans with the arrow keys and zooms around the middle of the window with +/-
+    vec2 pan;
+    if (keyboard[SDL_SCANCODE_UP] == SDL_PRESSED)
+        pan.y -= 1;
+    if (keyboard[SDL_SCANCODE_DOWN] == SDL_PRESSED)
+        pan.y += 1;
+    if (keyboard[SDL_SCANCODE_RIGHT] == SDL_PRESSED)
+        pan.x += 1;
+    if (keyboard[SDL_SCANCODE_LEFT] == SDL_PRESSED)
+        pan.x -= 1;
+    camera.pos = camera.pos + pan * (CAMERA_PAN_SPEED * deltaTimeD / camera.zoom);
+    if (keyboard[SDL_SCANCODE_EQUALS] == SDL_PRESSED || keyboard[SDL_SCANCODE_KP_PLUS] == SDL_PRESSED)
+        camera.zoom = std::min(camera.zoom * static_cast<float>(pow(CAMERA_ZOOM_SPEED, deltaTimeD)), CAMERA_MAX_ZOOM);
+    if (keyboard[SDL_SCANCODE_MINUS] == SDL_PRESSED || keyboard[SDL_SCANCODE_KP_MINUS] == SDL_PRESSED)
+        camera.zoom = std::max(camera.zoom / static_cast<float>(pow(CAMERA_ZOOM_SPEED, deltaTimeD)), CAMERA_MIN_ZOOM);
+
+    if (keyboard[SDL_SCANCODE_1] == SDL_PRESSED)
+        renderMode = RENDER_MODE_GFX;
+    if (keyboard[SDL_SCANCODE_2] == SDL_PRESSED)
+        renderMode = RENDER_MODE_SOFTWARE;
+    if (keyboard[SDL_SCANCODE_3] == SDL_PRESSED)
+        renderMode = RENDER_MODE_GEOMETRY;
+    if (keyboard[SDL_SCANCODE_4] == SDL_PRESSED)
+        renderMode = RENDER_MODE_FIELD;
+    if (keyboard[SDL_SCANCODE_5] == SDL_PRESSED)
+        renderMode = RENDER_MODE_SHADED;
+    // which field the field view shows: C the cache, E the exact one, X where they differ
+    if (keyboard[SDL_SCANCODE_C] == SDL_PRESSED)
+        fieldSource = FIELD_SOURCE_CACHE;
+    if (keyboard[SDL_SCANCODE_E] == SDL_PRESSED)
+        fieldSource = FIELD_SOURCE_EXACT;
+    if (keyboard[SDL_SCANCODE_X] == SDL_PRESSED)
+        fieldSource = FIELD_SOURCE_ERROR;
+
+    // P marches the next frame while the current one is drawn, O runs both stages in turn
+    if (keyboard[SDL_SCANCODE_P] == SDL_PRESSED)
+        pipelineFrames = true;
+    if (keyboard[SDL_SCANCODE_O] == SDL_PRESSED)
+        pipelineFrames = false;
+
+    // G lets the governors lower the resolution and thin out the rays to hold the frame time,
+    // F keeps full quality. L stretches a lowered resolution with the renderer, Z with zoomSurface
+    if (keyboard[SDL_SCANCODE_G] == SDL_PRESSED) {
+        governResolution = true;
+        qualityGovernor.enabled = true;
+    }
+    if (keyboard[SDL_SCANCODE_F] == SDL_PRESSED && governResolution) {
+        governResolution = false;
+        qualityGovernor.enabled = false;
+        reset_resolution_governor(resolutionGovernor);
+        apply_resolution_scale();
+    }
+    if (keyboard[SDL_SCANCODE_L] == SDL_PRESSED)
+        upscaleMode = UPSCALE_RENDERER;
+    if (keyboard[SDL_SCANCODE_Z] == SDL_PRESSED)
+        upscaleMode = UPSCALE_ZOOM_SURFACE;
+
+    // J turns the lights into area lights with soft shadows, H back into points. Only the
+    // software and shaded fills draw the penumbra.
+    if (keyboard[SDL_SCANCODE_J] == SDL_PRESSED)
+        for (auto l : lights)
+            l->penumbra = LIGHT_AREA_PENUMBRA;
+    if (keyboard[SDL_SCANCODE_H] == SDL_PRESSED)
+        for (auto l : lights)
+            l->penumbra = 0;
+
+    // V finds the lights' visibility with the polar engine, M marches their rays again
+    if (keyboard[SDL_SCANCODE_V] == SDL_PRESSED)
+        visibilityEngine = VISIBILITY_POLAR;
+    if (keyboard[SDL_SCANCODE_M] == SDL_PRESSED)
+        visibilityEngine = VISIBILITY_MARCH;
+
+    if (keyboard[SDL_SCANCODE_R] == SDL_PRESSED)
+        request_pm_cache_rebuild();
     if (keyboard[SDL_SCANCODE_Q] == SDL_PRESSED)
-        exit(0);
+        quitRequested = true;
 }
 
 uint64_t deltaTime;
 uint64_t startTime, endTime;
+// the governor needs finer frame times than the millisecond ticks
+uint64_t startCounter;
 int main() {
     // initialize sdl
     SDL_Init(SDL_INIT_VIDEO);
     SDL_CreateWindowAndRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, 0, &window, &renderer);
+    create_framebuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
 
-    create_drawables();
+    create_drawables(time(0));
     create_lights();
     
     // pre-calculate the light directions
-    for (int i = 0; i < LIGHT_DIR_COUNT; i++) {
-        light_directions[i] = { static_cast<float>(cos(static_cast<float>(i) / LIGHT_DIR_COUNT * 2 * PI)), static_cast<float>(sin(static_cast<float>(i) / LIGHT_DIR_COUNT * 2 * PI)) };
-    }
-    // pre-calculate the pointmarching cache for raymarching
-    precalc_pm_cache();
+    create_light_directions();
+    // bake the pointmarching cache for raymarching in the background, the first frames march exactly
+    start_pm_cache_builder();
+    request_pm_cache_rebuild();
 
-    // workaround player
-    drawables.emplace_back(new Circle{ { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }, 30 });
+    // moving obstacles stay out of the cache
+    create_dynamic_drawables();
     Drawable *player = lights.front();
 
+    // march the lights on a worker while the main thread draws, within the march budget
+    qualityGovernor.enabled = true;
+    start_light_queue();
+    start_frame_pipeline();
+    start_field_view();
+    FrameTrace *frame { nullptr };
+
     // render loop
     while (1) {
         startTime = SDL_GetTicks64();
+        startCounter = SDL_GetPerformanceCounter();
     
         // poll window and quit if needed
         if (SDL_PollEvent(&event) && event.type == SDL_QUIT)
             break;
         
         move_player(player);
-
+        if (quitRequested)
+            break;
+        move_dynamic_drawables(startTime / 1000.0);
+        // the scene only changes above, while the march stage is idle. Pipelined, the frame
+        // drawn below is the one marched during the previous iteration.
+        // the field view doesn't need the lights
+        if (renderMode != RENDER_MODE_FIELD)
+            submit_frame_trace(acquire_pm_cache(), camera, renderMode == RENDER_MODE_GEOMETRY);
+        if (!pipelineFrames)
+            frame = wait_frame_trace();
+
+        if (renderMode == RENDER_MODE_SOFTWARE)
+            fb_clear(framebuffer, fb_color(DEF_BG_COL_R, DEF_BG_COL_G, DEF_BG_COL_B, DEF_BG_COL_A));
         SDL_SetRenderDrawColor(renderer, DEF_BG_COL_R, DEF_BG_COL_G, DEF_BG_COL_B, DEF_BG_COL_A);
         SDL_RenderClear(renderer);
         SDL_SetRenderDrawColor(renderer, DEF_COL_R, DEF_COL_G, DEF_COL_B, DEF_COL_A);
 
-        // for (int x = 0; x < WINDOW_WIDTH; x++) {
-        //     for (int y = 0; y < WINDOW_HEIGHT; y++) {
-        //         float c = pm_cache({(float)x, (float)y});
-        //         SDL_SetRenderDrawColor(renderer, c, c, c, 255);
-        //         SDL_RenderDrawPoint(renderer, x, y);
-        //     }
-        // }
-
         // you may guess 3 times
-        draw();
+        if (renderMode == RENDER_MODE_FIELD)
+            draw_field(framebuffer, acquire_pm_cache(), camera, fieldSource, resolutionGovernor.scale);
+        else if (frame)
+            draw(*frame);
+        if (renderMode == RENDER_MODE_SOFTWARE || renderMode == RENDER_MODE_FIELD || renderMode == RENDER_MODE_SHADED)
+            fb_present(framebuffer);
+        // debug points go on top of whatever the render mode drew
+        flush_points();
 
         SDL_RenderPresent(renderer);
+        if (pipelineFrames)
+            frame = wait_frame_trace();
         
         endTime = SDL_GetTicks64();
         deltaTime = endTime - startTime;
         deltaTimeD = deltaTime / 1000.0;
-        printf("\rDelta Time is: %lli     ", deltaTime);
+
+        // only the framebuffer modes get cheaper at a lower resolution
+        double frameMs { (SDL_GetPerformanceCounter() - startCounter) * 1000.0 / SDL_GetPerformanceFrequency() };
+        if (governResolution && (renderMode == RENDER_MODE_SOFTWARE || renderMode == RENDER_MODE_FIELD || renderMode == RENDER_MODE_SHADED)
+            && update_resolution_governor(resolutionGovernor, frameMs))
+            apply_resolution_scale();
+
+        printf("\rDelta Time is: %lli  Resolution: %d%%  Rays: %zu     ", deltaTime, static_cast<int>(resolutionGovernor.scale * 100), frame ? frame->rays : 0);
         fflush(stdout);
     }
 
+    // the march stage may still be tracing the last submitted frame
+    wait_frame_trace();
+    stop_frame_pipeline();
+    stop_light_queue();
+    stop_field_view();
+    stop_pm_cache_builder();
     destroy_drawables();
+    destroy_dynamic_drawables();
+    destroy_lights();
 
     // tidy up sdl
+    destroy_framebuffer();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
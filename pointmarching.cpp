@@ -0,0 +1,2068 @@
+#include "pointmarching.h"
+
+float clip(float n, float lower, float upper) {
+    return std::max(lower, std::min(n, upper));
+}
+
+/* -------------------------
+ *      Rendering Stuff
+ * -------------------------
+*/
+
+float exit_distance(vec2 pos, vec2 dir, Bounds bounds) {
+    float enter { 0 }, exit { 1e30f };
+    float p[2] { pos.x, pos.y }, d[2] { dir.x, dir.y };
+    float lo[2] { bounds.min.x, bounds.min.y }, hi[2] { bounds.max.x, bounds.max.y };
+    for (int i = 0; i < 2; i++) {
+        if (d[i] == 0) {
+            if (p[i] < lo[i] || p[i] > hi[i])
+                return -1;
+            continue;
+        }
+        float t1 = (lo[i] - p[i]) / d[i];
+        float t2 = (hi[i] - p[i]) / d[i];
+        enter = std::max(enter, std::min(t1, t2));
+        exit = std::min(exit, std::max(t1, t2));
+    }
+    return exit >= enter ? exit : -1;
+}
+
+Camera camera;
+
+/* -------------------------
+ *    Software Rendering
+ * -------------------------
+*/
+
+Framebuffer framebuffer;
+
+uint32_t fb_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return static_cast<uint32_t>(a) << 24 | static_cast<uint32_t>(r) << 16 | static_cast<uint32_t>(g) << 8 | b;
+}
+uint32_t fb_blend(uint32_t dst, uint32_t src) {
+    uint32_t a = src >> 24;
+    if (a == 255)
+        return src;
+    uint32_t rb = ((src & 0xff00ff) * a + (dst & 0xff00ff) * (255 - a)) >> 8 & 0xff00ff;
+    uint32_t g = ((src & 0xff00) * a + (dst & 0xff00) * (255 - a)) >> 8 & 0xff00;
+    return 0xff000000 | rb | g;
+}
+
+void init_framebuffer(Framebuffer &fb, int width, int height) {
+    fb.width = width;
+    fb.height = height;
+    fb.pixels.assign(static_cast<size_t>(width) * height, 0);
+}
+
+void fb_clear(Framebuffer &fb, uint32_t color) {
+    std::fill(fb.pixels.begin(), fb.pixels.end(), color);
+}
+void fb_point(Framebuffer &fb, int x, int y, uint32_t color) {
+    if (x < 0 || y < 0 || x >= fb.width || y >= fb.height)
+        return;
+    uint32_t &dst = fb.pixels[x + static_cast<size_t>(y) * fb.width];
+    dst = fb_blend(dst, color);
+}
+void fb_span(Framebuffer &fb, int x1, int x2, int y, uint32_t color) {
+    if (y < 0 || y >= fb.height)
+        return;
+    if (x1 > x2)
+        std::swap(x1, x2);
+    x1 = std::max(x1, 0);
+    x2 = std::min(x2, fb.width - 1);
+    if (x1 > x2)
+        return;
+    uint32_t *row = fb.pixels.data() + static_cast<size_t>(y) * fb.width;
+    if (color >> 24 == 255) {
+        std::fill(row + x1, row + x2 + 1, color);
+    } else {
+        for (int x = x1; x <= x2; x++)
+            row[x] = fb_blend(row[x], color);
+    }
+}
+void fb_fill_circle(Framebuffer &fb, int cx, int cy, int radius, uint32_t color) {
+    for (int dy = -radius; dy <= radius; dy++) {
+        int dx = static_cast<int>(sqrtf(static_cast<float>(radius * radius - dy * dy)));
+        fb_span(fb, cx - dx, cx + dx, cy + dy, color);
+    }
+}
+
+struct FbEdge {
+    int x1, y1, x2, y2;
+};
+// Scanline fill with the same coverage rules as filledPolygonRGBA. Edges are bucketed by their
+// top row once and only the ones crossing the current row are looked at, rows outside the
+// buffer are skipped entirely.
+void fb_fill_polygon(Framebuffer &fb, const int16_t *vx, const int16_t *vy, int n, uint32_t color) {
+    if (n < 3)
+        return;
+    static thread_local std::vector<FbEdge> edges;
+    static thread_local std::vector<FbEdge> active;
+    // 16.16 fixed point, 64 bits so vertices anywhere in the int16 range can't overflow
+    static thread_local std::vector<int64_t> ints;
+    edges.clear();
+    active.clear();
+
+    int miny { vy[0] }, maxy { vy[0] };
+    for (int i = 0; i < n; i++) {
+        int prev = i ? i - 1 : n - 1;
+        miny = std::min<int>(miny, vy[i]);
+        maxy = std::max<int>(maxy, vy[i]);
+        if (vy[prev] < vy[i])
+            edges.push_back({ vx[prev], vy[prev], vx[i], vy[i] });
+        else if (vy[prev] > vy[i])
+            edges.push_back({ vx[i], vy[i], vx[prev], vy[prev] });
+    }
+    std::sort(edges.begin(), edges.end(), [](const FbEdge &a, const FbEdge &b) { return a.y1 < b.y1; });
+
+    size_t next { 0 };
+    int endY { std::min(maxy, fb.height - 1) };
+    for (int y = std::max(miny, 0); y <= endY; y++) {
+        while (next < edges.size() && edges[next].y1 <= y)
+            active.push_back(edges[next++]);
+        // edges ending on this row only count on the last row
+        active.erase(std::remove_if(active.begin(), active.end(), [&](const FbEdge &e) {
+            return e.y2 < y || (e.y2 == y && y != maxy);
+        }), active.end());
+
+        ints.clear();
+        for (auto &e : active) {
+            if (y == e.y1 && y == maxy)
+                continue;
+            ints.push_back(((INT64_C(65536) * (y - e.y1)) / (e.y2 - e.y1)) * (e.x2 - e.x1) + INT64_C(65536) * e.x1);
+        }
+        // the order barely changes between rows, insertion sort is close to linear
+        for (size_t i = 1; i < ints.size(); i++) {
+            int64_t v = ints[i];
+            size_t j = i;
+            for (; j > 0 && ints[j - 1] > v; j--)
+                ints[j] = ints[j - 1];
+            ints[j] = v;
+        }
+        for (size_t i = 0; i + 1 < ints.size(); i += 2) {
+            int64_t xa = ints[i] + 1;
+            xa = (xa >> 16) + ((xa & 32768) >> 15);
+            int64_t xb = ints[i + 1] - 1;
+            xb = (xb >> 16) + ((xb & 32768) >> 15);
+            fb_span(fb, static_cast<int>(xa), static_cast<int>(xb), y, color);
+        }
+    }
+}
+
+/* -------------------------
+ *     HDR Accumulation
+ * -------------------------
+*/
+
+void hdr_begin(HdrBuffer &hdr, int width, int height) {
+    hdr.width = width;
+    hdr.height = height;
+    hdr.splats.clear();
+    // the span lists keep their storage between frames
+    hdr.bands.resize((height + HDR_BAND_ROWS - 1) / HDR_BAND_ROWS);
+    for (auto &band : hdr.bands)
+        band.clear();
+}
+
+int hdr_add_splat(HdrBuffer &hdr, vec2 centre, float radius, LightColor radiance, const ShadowMap *shadow) {
+    if (radius <= 0 || hdr.splats.size() > UINT16_MAX)
+        return -1;
+    hdr.splats.push_back({ centre, radius, radiance, shadow });
+    return static_cast<int>(hdr.splats.size()) - 1;
+}
+
+// clips [x1, x2] on row y to the splat's radius and the buffer and sorts it into its band
+void hdr_push_span(HdrBuffer &hdr, int splat, int x1, int x2, int y, float shade, float shadeStep) {
+    if (y < 0 || y >= hdr.height)
+        return;
+    const HdrSplat &s = hdr.splats[splat];
+    // pixel centres, nothing is added beyond the radius
+    float dy { y + 0.5f - s.centre.y };
+    float reach2 { s.radius * s.radius - dy * dy };
+    if (reach2 <= 0)
+        return;
+    float reach { sqrtf(reach2) };
+    int start { std::max({ x1, 0, static_cast<int>(floorf(s.centre.x - reach - 0.5f)) }) };
+    x2 = std::min({ x2, hdr.width - 1, static_cast<int>(ceilf(s.centre.x + reach - 0.5f)) });
+    if (start > x2)
+        return;
+    hdr.bands[y / HDR_BAND_ROWS].push_back({ static_cast<int16_t>(start), static_cast<int16_t>(x2), static_cast<int16_t>(y),
+        static_cast<uint16_t>(splat), shade + shadeStep * (start - x1), shadeStep });
+}
+
+// x where the edge from to crosses the row at py, the same for every polygon and triangle
+// sharing the edge so their pixels meet exactly
+inline float edge_x(vec2 from, vec2 to, float py) {
+    if (from.y > to.y)
+        std::swap(from, to);
+    return from.x + (to.x - from.x) * (py - from.y) / (to.y - from.y);
+}
+
+// pixels whose centres lie inside the polygon by the even-odd rule
+void hdr_splat_polygon(HdrBuffer &hdr, int splat, const vec2 *points, int n) {
+    if (splat < 0 || n < 3)
+        return;
+    static thread_local std::vector<float> xs;
+    float minY { points[0].y }, maxY { points[0].y };
+    for (int i = 1; i < n; i++) {
+        minY = std::min(minY, points[i].y);
+        maxY = std::max(maxY, points[i].y);
+    }
+    int y1 { std::max(static_cast<int>(ceilf(minY - 0.5f)), 0) };
+    int y2 { std::min(static_cast<int>(ceilf(maxY - 0.5f)) - 1, hdr.height - 1) };
+    for (int y = y1; y <= y2; y++) {
+        float py { y + 0.5f };
+        xs.clear();
+        for (int i = 0; i < n; i++) {
+            vec2 from = points[i ? i - 1 : n - 1], to = points[i];
+            // every edge covers the rows from its upper end up to but not including its lower end
+            if ((from.y <= py) != (to.y <= py))
+                xs.push_back(edge_x(from, to, py));
+        }
+        std::sort(xs.begin(), xs.end());
+        for (size_t i = 0; i + 1 < xs.size(); i += 2) {
+            int x1 { static_cast<int>(ceilf(xs[i] - 0.5f)) };
+            int x2 { static_cast<int>(ceilf(xs[i + 1] - 0.5f)) - 1 };
+            if (x1 <= x2)
+                hdr_push_span(hdr, splat, x1, x2, y, 1, 0);
+        }
+    }
+}
+
+// pixels whose centres lie inside the triangle, edges shared with a neighbour belong to one of them
+void hdr_splat_triangle(HdrBuffer &hdr, int splat, vec2 a, vec2 b, vec2 c, float shadeA, float shadeB, float shadeC) {
+    float area { cross(b - a, c - a) };
+    if (splat < 0 || std::abs(area) < 1e-6f)
+        return;
+    // the shade is a plane over the screen
+    float shadeDx { ((shadeB - shadeA) * (c.y - a.y) - (shadeC - shadeA) * (b.y - a.y)) / area };
+    float shadeDy { ((shadeC - shadeA) * (b.x - a.x) - (shadeB - shadeA) * (c.x - a.x)) / area };
+    vec2 corners[3] { a, b, c };
+    std::sort(corners, corners + 3, [](vec2 p, vec2 q) { return p.y < q.y; });
+    int y1 { std::max(static_cast<int>(ceilf(corners[0].y - 0.5f)), 0) };
+    int y2 { std::min(static_cast<int>(ceilf(corners[2].y - 0.5f)) - 1, hdr.height - 1) };
+    for (int y = y1; y <= y2; y++) {
+        float py { y + 0.5f };
+        // the long edge and whichever short edge spans the row
+        float xLong { edge_x(corners[0], corners[2], py) };
+        float xShort { py < corners[1].y ? edge_x(corners[0], corners[1], py) : edge_x(corners[1], corners[2], py) };
+        int x1 { static_cast<int>(ceilf(std::min(xLong, xShort) - 0.5f)) };
+        int x2 { static_cast<int>(ceilf(std::max(xLong, xShort) - 0.5f)) - 1 };
+        if (x1 > x2)
+            continue;
+        float shade { shadeA + shadeDx * (x1 + 0.5f - a.x) + shadeDy * (py - a.y) };
+        hdr_push_span(hdr, splat, x1, x2, y, shade, shadeDx);
+    }
+}
+
+void hdr_splat_disc(HdrBuffer &hdr, int splat) {
+    if (splat < 0)
+        return;
+    const HdrSplat &s = hdr.splats[splat];
+    int y1 { static_cast<int>(std::max(floorf(s.centre.y - s.radius), 0.f)) };
+    int y2 { static_cast<int>(std::min(ceilf(s.centre.y + s.radius), hdr.height - 1.f)) };
+    for (int y = y1; y <= y2; y++)
+        hdr_push_span(hdr, splat, 0, hdr.width - 1, y, 1, 0);
+}
+
+// adds a span's light into the band that starts at row top
+void hdr_add_span(HdrBuffer &hdr, const HdrSpan &span, int top) {
+    const HdrSplat &splat = hdr.splats[span.splat];
+    size_t row { static_cast<size_t>(span.y - top) * hdr.width };
+    float *r = hdr.r.data() + row;
+    float *g = hdr.g.data() + row;
+    float *b = hdr.b.data() + row;
+    float dy { span.y + 0.5f - splat.centre.y };
+    float invRadius { 1 / splat.radius };
+    // the map's share of the light at every pixel of the span
+    static thread_local std::vector<float> visibility;
+    if (splat.shadow) {
+        visibility.resize(span.x2 - span.x1 + 1);
+        shadow_row(*splat.shadow, span.x1 + 0.5f - splat.centre.x, dy, static_cast<int>(visibility.size()),
+            splat.radius / splat.shadow->radius, visibility.data());
+    }
+    int x { span.x1 };
+#ifdef HDR_SSE2
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 steps = _mm_setr_ps(0, 1, 2, 3);
+    const __m128 cx = _mm_set1_ps(splat.centre.x);
+    const __m128 dy2 = _mm_set1_ps(dy * dy);
+    const __m128 inv = _mm_set1_ps(invRadius);
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 shadeStep = _mm_set1_ps(span.shadeStep);
+    // a constant shade goes into the colour
+    bool flat { span.shadeStep == 0 };
+    const __m128 cr = _mm_set1_ps(splat.radiance.r * (flat ? span.shade : 1));
+    const __m128 cg = _mm_set1_ps(splat.radiance.g * (flat ? span.shade : 1));
+    const __m128 cb = _mm_set1_ps(splat.radiance.b * (flat ? span.shade : 1));
+    for (; x + 3 <= span.x2; x += 4) {
+        __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets), cx);
+        __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2));
+        __m128 falloff = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(d, inv)), zero);
+        if (!flat)
+            falloff = _mm_mul_ps(falloff, _mm_add_ps(_mm_set1_ps(span.shade + span.shadeStep * (x - span.x1)), _mm_mul_ps(steps, shadeStep)));
+        if (splat.shadow)
+            falloff = _mm_mul_ps(falloff, _mm_loadu_ps(visibility.data() + (x - span.x1)));
+        _mm_storeu_ps(r + x, _mm_add_ps(_mm_loadu_ps(r + x), _mm_mul_ps(falloff, cr)));
+        _mm_storeu_ps(g + x, _mm_add_ps(_mm_loadu_ps(g + x), _mm_mul_ps(falloff, cg)));
+        _mm_storeu_ps(b + x, _mm_add_ps(_mm_loadu_ps(b + x), _mm_mul_ps(falloff, cb)));
+    }
+#endif
+    for (; x <= span.x2; x++) {
+        float dx { x + 0.5f - splat.centre.x };
+        float falloff { std::max(1 - sqrtf(dx * dx + dy * dy) * invRadius, 0.f) * (span.shade + span.shadeStep * (x - span.x1)) };
+        if (splat.shadow)
+            falloff *= visibility[x - span.x1];
+        r[x] += falloff * splat.radiance.r;
+        g[x] += falloff * splat.radiance.g;
+        b[x] += falloff * splat.radiance.b;
+    }
+}
+
+#ifdef HDR_SSE2
+// background plus the compressed light times the headroom above the background, rounded
+inline __m128i tonemap_lanes(__m128 light, __m128 background, __m128 headroom) {
+    // the penumbra may take a hair more than its light added
+    light = _mm_max_ps(light, _mm_setzero_ps());
+    __m128 compressed = _mm_div_ps(light, _mm_add_ps(light, _mm_set1_ps(1)));
+    return _mm_cvtps_epi32(_mm_add_ps(background, _mm_mul_ps(headroom, compressed)));
+}
+#endif
+
+// tonemaps the first n pixels of the band into out
+void hdr_tonemap(const HdrBuffer &hdr, uint32_t *out, size_t n, uint32_t background) {
+    float bg[3] { static_cast<float>(background >> 16 & 0xff), static_cast<float>(background >> 8 & 0xff),
+        static_cast<float>(background & 0xff) };
+    const float *planes[3] { hdr.r.data(), hdr.g.data(), hdr.b.data() };
+    size_t i { 0 };
+#ifdef HDR_SSE2
+    const __m128 bgR = _mm_set1_ps(bg[0]), bgG = _mm_set1_ps(bg[1]), bgB = _mm_set1_ps(bg[2]);
+    const __m128 roomR = _mm_set1_ps(255 - bg[0]), roomG = _mm_set1_ps(255 - bg[1]), roomB = _mm_set1_ps(255 - bg[2]);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+    for (; i + 4 <= n; i += 4) {
+        __m128i r = tonemap_lanes(_mm_loadu_ps(planes[0] + i), bgR, roomR);
+        __m128i g = tonemap_lanes(_mm_loadu_ps(planes[1] + i), bgG, roomG);
+        __m128i b = tonemap_lanes(_mm_loadu_ps(planes[2] + i), bgB, roomB);
+        __m128i pixel = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r, 16)), _mm_or_si128(_mm_slli_epi32(g, 8), b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), pixel);
+    }
+#endif
+    for (; i < n; i++) {
+        uint8_t channels[3];
+        for (int c = 0; c < 3; c++) {
+            float light { std::max(planes[c][i], 0.f) };
+            channels[c] = static_cast<uint8_t>(lrintf(bg[c] + (255 - bg[c]) * light / (light + 1)));
+        }
+        out[i] = fb_color(channels[0], channels[1], channels[2], 255);
+    }
+}
+
+void hdr_resolve(HdrBuffer &hdr, Framebuffer &fb, uint32_t background) {
+    size_t bandSize { static_cast<size_t>(hdr.width) * HDR_BAND_ROWS };
+    hdr.r.resize(bandSize);
+    hdr.g.resize(bandSize);
+    hdr.b.resize(bandSize);
+    for (size_t band = 0; band < hdr.bands.size(); band++) {
+        int top { static_cast<int>(band) * HDR_BAND_ROWS };
+        size_t n { static_cast<size_t>(std::min(HDR_BAND_ROWS, hdr.height - top)) * hdr.width };
+        std::fill(hdr.r.begin(), hdr.r.begin() + n, 0.f);
+        std::fill(hdr.g.begin(), hdr.g.begin() + n, 0.f);
+        std::fill(hdr.b.begin(), hdr.b.begin() + n, 0.f);
+        for (const HdrSpan &span : hdr.bands[band])
+            hdr_add_span(hdr, span, top);
+        hdr_tonemap(hdr, fb.pixels.data() + static_cast<size_t>(top) * fb.width, n, background);
+    }
+}
+
+/* -------------------------
+ *       Drawable Stuff
+ * -------------------------
+*/
+
+std::vector<Drawable*> drawables;
+void create_drawables(unsigned int seed) {
+    srand(seed);
+
+    for (int i = 0; i < RANDOM_CIRCLE_COUNT; i++) {
+        int radius = rand() % (RANDOM_CIRCLE_MAX_SIZE - RANDOM_CIRCLE_MIN_SIZE) + RANDOM_CIRCLE_MIN_SIZE;
+        vec2 pos = { rand() % (WINDOW_WIDTH - 2 * radius) + radius, rand() % (WINDOW_HEIGHT - 2 * radius) + radius };
+        drawables.emplace_back(new Circle{ pos, radius });
+    }
+    
+    drawables.emplace_back(new Rectangle{ {WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2}, {200, 100} });
+}
+void destroy_drawables() {
+    for (auto d : drawables)
+        delete d;
+}
+
+/* -------------------------
+ *       Dynamic Layer
+ * -------------------------
+*/
+
+DynamicLayer dynamicLayer;
+
+void pad_lanes(std::vector<float> &v, float value) {
+    while (v.size() % DYNAMIC_LANES)
+        v.push_back(value);
+}
+
+void DynamicLayer::sync() {
+    circleX.clear(); circleY.clear(); circleR.clear(); circles.clear();
+    rectX.clear(); rectY.clear(); rectHalfW.clear(); rectHalfH.clear(); rects.clear();
+    others.clear();
+    for (auto d : drawables) {
+        if (auto c = dynamic_cast<Circle*>(d)) {
+            circleX.push_back(c->pos.x);
+            circleY.push_back(c->pos.y);
+            circleR.push_back(c->radius);
+            circles.push_back(c);
+        } else if (auto r = dynamic_cast<Rectangle*>(d)) {
+            rectX.push_back(r->pos.x);
+            rectY.push_back(r->pos.y);
+            rectHalfW.push_back(r->size.x / 2);
+            rectHalfH.push_back(r->size.y / 2);
+            rects.push_back(r);
+        } else {
+            others.push_back(d);
+        }
+    }
+    // padding lanes sit far away so they never win the min
+    pad_lanes(circleX, DYNAMIC_PAD_POS); pad_lanes(circleY, DYNAMIC_PAD_POS); pad_lanes(circleR, 0);
+    pad_lanes(rectX, DYNAMIC_PAD_POS); pad_lanes(rectY, DYNAMIC_PAD_POS); pad_lanes(rectHalfW, 0); pad_lanes(rectHalfH, 0);
+}
+
+#ifdef DYNAMIC_LAYER_SSE2
+// keeps the smaller distance and its index per lane
+inline void lane_min(__m128 dist, __m128i index, __m128 &min, __m128i &minIndex) {
+    __m128 less = _mm_cmplt_ps(dist, min);
+    __m128i lessI = _mm_castps_si128(less);
+    min = _mm_or_ps(_mm_and_ps(less, dist), _mm_andnot_ps(less, min));
+    minIndex = _mm_or_si128(_mm_and_si128(lessI, index), _mm_andnot_si128(lessI, minIndex));
+}
+// horizontal reduction, returns the lane index or -1 if no lane is below min
+inline int reduce_lanes(__m128 min, __m128i minIndex, float &best) {
+    alignas(16) float d[DYNAMIC_LANES];
+    alignas(16) int32_t idx[DYNAMIC_LANES];
+    _mm_store_ps(d, min);
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx), minIndex);
+    int found { -1 };
+    for (int i = 0; i < DYNAMIC_LANES; i++) {
+        if (d[i] < best) {
+            best = d[i];
+            found = idx[i];
+        }
+    }
+    return found;
+}
+#endif
+
+// combines the exact distance to the dynamic drawables with the given static distance,
+// updates drawable if a dynamic one is nearer
+float DynamicLayer::min_dist(vec2 pos, float min, Drawable **drawable) {
+#ifdef DYNAMIC_LAYER_SSE2
+    const __m128 px = _mm_set1_ps(pos.x);
+    const __m128 py = _mm_set1_ps(pos.y);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i step = _mm_set1_epi32(DYNAMIC_LANES);
+
+    if (!circles.empty()) {
+        __m128 vmin = _mm_set1_ps(min);
+        __m128i vidx = _mm_set1_epi32(-1);
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        for (size_t i = 0; i < circleX.size(); i += DYNAMIC_LANES) {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&circleX[i]), px);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&circleY[i]), py);
+            __m128 d = _mm_sub_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))), _mm_loadu_ps(&circleR[i]));
+            lane_min(d, index, vmin, vidx);
+            index = _mm_add_epi32(index, step);
+        }
+        int found { reduce_lanes(vmin, vidx, min) };
+        if (found >= 0 && drawable)
+            *drawable = circles[found];
+    }
+    if (!rects.empty()) {
+        __m128 vmin = _mm_set1_ps(min);
+        __m128i vidx = _mm_set1_epi32(-1);
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        for (size_t i = 0; i < rectX.size(); i += DYNAMIC_LANES) {
+            __m128 dx = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&rectX[i]), px), signMask), _mm_loadu_ps(&rectHalfW[i]));
+            __m128 dy = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&rectY[i]), py), signMask), _mm_loadu_ps(&rectHalfH[i]));
+            __m128 ox = _mm_max_ps(dx, zero);
+            __m128 oy = _mm_max_ps(dy, zero);
+            __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)));
+            __m128 inside = _mm_min_ps(_mm_max_ps(dx, dy), zero);
+            lane_min(_mm_add_ps(outside, inside), index, vmin, vidx);
+            index = _mm_add_epi32(index, step);
+        }
+        int found { reduce_lanes(vmin, vidx, min) };
+        if (found >= 0 && drawable)
+            *drawable = rects[found];
+    }
+#else
+    for (auto d : circles) {
+        float newDist { d->sdf(pos) };
+        if (newDist < min) {
+            min = newDist;
+            if (drawable)
+                *drawable = d;
+        }
+    }
+    for (auto d : rects) {
+        float newDist { d->sdf(pos) };
+        if (newDist < min) {
+            min = newDist;
+            if (drawable)
+                *drawable = d;
+        }
+    }
+#endif
+    for (auto d : others) {
+        float newDist { d->sdf(pos) };
+        if (newDist < min) {
+            min = newDist;
+            if (drawable)
+                *drawable = d;
+        }
+    }
+    return min;
+}
+
+void DynamicLayer::min_dist_row(vec2 pos, float step, int n, float *min) {
+    int i { 0 };
+#ifdef DYNAMIC_LAYER_SSE2
+    const __m128 py = _mm_set1_ps(pos.y);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 offsets = _mm_setr_ps(0, step, 2 * step, 3 * step);
+    for (; i + DYNAMIC_LANES <= n; i += DYNAMIC_LANES) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(pos.x + i * step), offsets);
+        __m128 vmin = _mm_loadu_ps(min + i);
+        for (size_t k = 0; k < circles.size(); k++) {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(circleX[k]), px);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(circleY[k]), py);
+            __m128 d = _mm_sub_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))), _mm_set1_ps(circleR[k]));
+            vmin = _mm_min_ps(vmin, d);
+        }
+        for (size_t k = 0; k < rects.size(); k++) {
+            __m128 dx = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(rectX[k]), px), signMask), _mm_set1_ps(rectHalfW[k]));
+            __m128 dy = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(rectY[k]), py), signMask), _mm_set1_ps(rectHalfH[k]));
+            __m128 ox = _mm_max_ps(dx, zero);
+            __m128 oy = _mm_max_ps(dy, zero);
+            __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)));
+            __m128 inside = _mm_min_ps(_mm_max_ps(dx, dy), zero);
+            vmin = _mm_min_ps(vmin, _mm_add_ps(outside, inside));
+        }
+        _mm_storeu_ps(min + i, vmin);
+    }
+#endif
+    // whatever is left of the row, or all of it without SSE2
+    for (; i < n; i++) {
+        vec2 p { pos.x + i * step, pos.y };
+        for (auto d : circles)
+            min[i] = std::min(min[i], d->sdf(p));
+        for (auto d : rects)
+            min[i] = std::min(min[i], d->sdf(p));
+    }
+    if (others.empty())
+        return;
+    for (i = 0; i < n; i++) {
+        vec2 p { pos.x + i * step, pos.y };
+        for (auto d : others)
+            min[i] = std::min(min[i], d->sdf(p));
+    }
+}
+
+void create_dynamic_drawables() {
+    for (int i = 0; i < DYNAMIC_CIRCLE_COUNT; i++)
+        dynamicLayer.add(new Circle{ { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }, DYNAMIC_CIRCLE_SIZE });
+}
+void move_dynamic_drawables(double time) {
+    for (int i = 0; i < DYNAMIC_CIRCLE_COUNT; i++) {
+        float angle = time * DYNAMIC_ORBIT_SPEED + i * 2 * PI / DYNAMIC_CIRCLE_COUNT;
+        dynamicLayer.drawables[i]->pos = vec2{ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 } + vec2{ cosf(angle), sinf(angle) } * DYNAMIC_ORBIT_RADIUS;
+    }
+    dynamicLayer.sync();
+}
+void destroy_dynamic_drawables() {
+    for (auto d : dynamicLayer.drawables)
+        delete d;
+}
+
+float get_static_min_dist(vec2 pos, Drawable **drawable) {
+    float min { 10000.f };
+    for (auto d : drawables) {
+        float newDist { d->sdf(pos) };
+        if (newDist < min) {
+            min = newDist;
+            if (drawable)
+                *drawable = d;
+            if (min <= 0) {
+                break;
+            }
+        }
+    }
+    return min;
+}
+
+float get_min_dist(vec2 pos, Drawable **drawable) {
+    return dynamicLayer.min_dist(pos, get_static_min_dist(pos, drawable), drawable);
+}
+
+float get_min_dist(vec2 pos) {
+    return get_min_dist(pos, nullptr);
+}
+
+/* -------------------------
+ *        Light Stuff
+ * -------------------------
+*/
+
+std::vector<Light*> lights;
+void create_lights(int count) {
+    lights.emplace_back(new Light({ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }, 100.f, LIGHT_PRIORITY_PLAYER));
+    for (int i = 1; i < count; i++) {
+        vec2 pos = { static_cast<float>(rand() % WINDOW_WIDTH), static_cast<float>(rand() % WINDOW_HEIGHT) };
+        float brightness = rand() % (EXTRA_LIGHT_MAX_BRIGHTNESS - EXTRA_LIGHT_MIN_BRIGHTNESS) + EXTRA_LIGHT_MIN_BRIGHTNESS;
+        LightColor color;
+        for (float *channel : { &color.r, &color.g, &color.b })
+            *channel = EXTRA_LIGHT_MIN_CHANNEL + (1 - EXTRA_LIGHT_MIN_CHANNEL) * (rand() % 256) / 255.f;
+        lights.emplace_back(new Light(pos, brightness, LIGHT_PRIORITY_DEFAULT, color));
+    }
+}
+void destroy_lights() {
+    for (auto l : lights)
+        delete l;
+}
+vec2 light_directions[LIGHT_DIR_COUNT];
+void create_light_directions() {
+    for (int i = 0; i < LIGHT_DIR_COUNT; i++) {
+        light_directions[i] = { static_cast<float>(cos(static_cast<float>(i) / LIGHT_DIR_COUNT * 2 * PI)), static_cast<float>(sin(static_cast<float>(i) / LIGHT_DIR_COUNT * 2 * PI)) };
+    }
+}
+
+bool march_ray(vec2 pos, vec2 delta, RayHitInfo* hit, Bounds bounds, float maxDepth, float threshold, uint16_t maxSteps, float penumbra) {
+    float min;
+    int depth { 0 };
+    delta.normalize();
+    vec2 origin = pos;
+    float exit { std::max(std::min(exit_distance(pos, delta, bounds), maxDepth), 0.f) };
+    hit->hit = false;
+    hit->distance = 0;
+    hit->shade = 1;
+    hit->shadeDistance = 0;
+    float lastMin { INFINITY };
+    do {
+        min = get_min_dist(pos, &hit->drawable);
+        if (min <= threshold) {
+            hit->hit = true;
+            break;
+        }
+        // the ray grazed something where the clearance stops shrinking, closing in on the surface
+        // it hits in the end doesn't count
+        if (penumbra > 0 && min > lastMin && hit->distance > lastMin && penumbra * lastMin < hit->shade * (hit->distance - lastMin)) {
+            hit->shade = penumbra * lastMin / (hit->distance - lastMin);
+            hit->shadeDistance = hit->distance - lastMin;
+        }
+        lastMin = min;
+        pos = pos + delta * min;
+        hit->distance += min;
+        depth++;
+    } while (depth < maxSteps && hit->distance < exit && min >= threshold);
+    if (hit->distance > exit) {
+        hit->distance = exit;
+        pos = origin + delta * exit;
+    }
+    hit->pos = pos;
+    return hit->hit;
+}
+
+float interpolate(float a, float b, float t) {
+    return a * (1 - t) + b * t;
+}
+float four_point_ip(float a, float b, float c, float d, vec2 delta, vec2 pointDelta) {
+    return interpolate(
+        interpolate(a, b, delta.x / pointDelta.x),
+        interpolate(d, c, delta.x / pointDelta.x),
+        delta.y / pointDelta.y
+    );
+}
+vec2 abs_point_around(vec2 pos, int index) {
+    switch(index) {
+        case 0:
+            return vec2( floorf(pos.x), floorf(pos.y) );
+        case 1:
+            return vec2( ceilf (pos.x), floorf(pos.y) );
+        case 2:
+            return vec2( ceilf (pos.x), ceilf (pos.y) );
+        case 3:
+            return vec2( floorf(pos.x), ceilf (pos.y) );
+        default:
+            return {};
+    }
+}
+
+uint64_t get_pm_chunk_key(int32_t x, int32_t y) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+}
+uint64_t get_pm_index(int32_t x, int32_t y) {
+    return x + y * PM_CHUNK_SIZE;
+}
+int32_t floor_div(int64_t a, int32_t b) {
+    return static_cast<int32_t>(a >= 0 ? a / b : -((-a + b - 1) / b));
+}
+
+std::shared_ptr<PmChunk> create_pm_chunk(const PmCache &cache, int32_t x, int32_t y) {
+    auto chunk = std::make_shared<PmChunk>();
+    chunk->x = x;
+    chunk->y = y;
+    for (auto &state : chunk->tileStates)
+        state.store(PM_TILE_EMPTY, std::memory_order_relaxed);
+
+    // sdfs are exact bounds, so everything further than the margin from the centre minus
+    // the half diagonal cannot be nearer than the margin anywhere in the chunk
+    float halfSize { PM_CHUNK_SIZE / 2.f / PM_CACHE_PRECISION };
+    vec2 centre { x * 2 * halfSize + halfSize, y * 2 * halfSize + halfSize };
+    for (auto d : cache.statics) {
+        if (d->sdf(centre) <= halfSize * sqrtf(2) + PM_CHUNK_MARGIN)
+            chunk->statics.push_back(d);
+    }
+    return chunk;
+}
+
+// returns the chunk at the given chunk coordinate, creating it and evicting the least
+// recently used ones beyond the budget. Evicted chunks stay alive while someone still holds them.
+std::shared_ptr<PmChunk> get_pm_chunk(PmCache &cache, int32_t x, int32_t y) {
+    uint64_t key { get_pm_chunk_key(x, y) };
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto found = cache.chunks.find(key);
+    if (found != cache.chunks.end()) {
+        cache.lru.splice(cache.lru.begin(), cache.lru, found->second.lru);
+        return found->second.chunk;
+    }
+
+    while (cache.chunks.size() >= PM_CHUNK_BUDGET) {
+        cache.chunks.erase(cache.lru.back());
+        cache.lru.pop_back();
+    }
+    cache.lru.push_front(key);
+    PmChunkSlot &slot = cache.chunks[key];
+    slot.chunk = create_pm_chunk(cache, x, y);
+    slot.lru = cache.lru.begin();
+    return slot.chunk;
+}
+
+// marchers mostly stay within one chunk for many steps, so every thread keeps
+// its last chunk at hand and only goes through the locked pool when it changes
+struct PmChunkRef {
+    const PmCache *cache { nullptr };
+    uint64_t generation { 0 };
+    std::shared_ptr<PmChunk> chunk;
+};
+thread_local PmChunkRef lastPmChunk;
+
+PmChunk* find_pm_chunk(PmCache &cache, int32_t x, int32_t y) {
+    PmChunkRef &last = lastPmChunk;
+    if (last.cache != &cache || last.generation != cache.generation || !last.chunk || last.chunk->x != x || last.chunk->y != y) {
+        last.cache = &cache;
+        last.generation = cache.generation;
+        last.chunk = get_pm_chunk(cache, x, y);
+    }
+    return last.chunk.get();
+}
+
+void build_pm_tile(PmCache &cache, PmChunk &chunk, int tileX, int tileY) {
+    vec2 it;
+    for (it.y = tileY * PM_TILE_SIZE; it.y < (tileY + 1) * PM_TILE_SIZE; it.y++) {
+        for (it.x = tileX * PM_TILE_SIZE; it.x < (tileX + 1) * PM_TILE_SIZE; it.x++) {
+            vec2 pos = (it + vec2{ static_cast<float>(chunk.x), static_cast<float>(chunk.y) } * PM_CHUNK_SIZE) / PM_CACHE_PRECISION;
+            float min { PM_CHUNK_MARGIN };
+            Drawable *nearest { nullptr };
+            for (auto d : chunk.statics) {
+                float newDist { d->sdf(pos) };
+                if (newDist < min) {
+                    min = newDist;
+                    nearest = d;
+                    if (min <= 0)
+                        break;
+                }
+            }
+            chunk.distances[get_pm_index(it.x, it.y)] = min;
+            chunk.drawables[get_pm_index(it.x, it.y)] = nearest;
+        }
+    }
+    cache.tilesBuilt++;
+}
+
+// makes sure the tile holding the given chunk texel is computed, concurrent callers
+// wait for the one that claimed the tile instead of computing it twice
+void ensure_pm_tile(PmCache &cache, PmChunk &chunk, int x, int y) {
+    int tileX { x / PM_TILE_SIZE };
+    int tileY { y / PM_TILE_SIZE };
+    std::atomic<uint8_t> &state = chunk.tileStates[tileX + tileY * PM_CHUNK_TILES];
+    if (state.load(std::memory_order_acquire) == PM_TILE_READY)
+        return;
+
+    uint8_t expected { PM_TILE_EMPTY };
+    if (state.compare_exchange_strong(expected, PM_TILE_BUILDING, std::memory_order_acquire)) {
+        build_pm_tile(cache, chunk, tileX, tileY);
+        state.store(PM_TILE_READY, std::memory_order_release);
+        return;
+    }
+    while (state.load(std::memory_order_acquire) != PM_TILE_READY)
+        std::this_thread::yield();
+}
+
+// looks up one cache texel in world texel coordinates, crossing chunk borders as needed
+PmChunk* pm_texel(PmCache &cache, int64_t x, int64_t y, uint64_t *index) {
+    int32_t chunkX { floor_div(x, PM_CHUNK_SIZE) };
+    int32_t chunkY { floor_div(y, PM_CHUNK_SIZE) };
+    int32_t localX { static_cast<int32_t>(x - static_cast<int64_t>(chunkX) * PM_CHUNK_SIZE) };
+    int32_t localY { static_cast<int32_t>(y - static_cast<int64_t>(chunkY) * PM_CHUNK_SIZE) };
+    PmChunk *chunk = find_pm_chunk(cache, chunkX, chunkY);
+    ensure_pm_tile(cache, *chunk, localX, localY);
+    *index = get_pm_index(localX, localY);
+    return chunk;
+}
+float pm_texel_dist(PmCache &cache, int64_t x, int64_t y) {
+    uint64_t index;
+    return pm_texel(cache, x, y, &index)->distances[index];
+}
+
+float pm_cache(PmCache &cache, vec2 pos) {
+    pos = pos * PM_CACHE_PRECISION;
+
+    int64_t x { static_cast<int64_t>(floor(pos.x)) };
+    int64_t y { static_cast<int64_t>(floor(pos.y)) };
+    float a = pm_texel_dist(cache, x,     y);
+    float b = pm_texel_dist(cache, x + 1, y);
+    float c = pm_texel_dist(cache, x + 1, y + 1);
+    float d = pm_texel_dist(cache, x,     y + 1);
+    vec2 origin = { floor(pos.x), floor(pos.y) };
+    vec2 delta = pos - origin;
+    float pointDelta = { 1.f / PM_CACHE_PRECISION };
+    return four_point_ip(a, b, c, d, delta, { pointDelta, pointDelta });
+}
+Drawable* pm_d_cache(PmCache &cache, vec2 pos) {
+    pos = pos * PM_CACHE_PRECISION;
+
+    // std::array<float, 4> all;
+    // int nearest = 0;
+    // for (int i = 0; i < 4; i++) {
+    //     all[i] = (pos - abs_point_around(pos, i)).sqr_mag();
+    //     for (int j = 0; j < i; j++) {
+    //         if (all[i] < all[j]) {
+    //             nearest = i;
+    //         }
+    //     }
+    // }
+
+    vec2 corner = abs_point_around(pos, 0);
+    uint64_t index;
+    PmChunk *chunk = pm_texel(cache, static_cast<int64_t>(corner.x), static_cast<int64_t>(corner.y), &index);
+    return chunk->drawables[index];
+}
+void prefetch_pm_chunk(PmCache &cache, int32_t x, int32_t y) {
+    std::shared_ptr<PmChunk> chunk = get_pm_chunk(cache, x, y);
+    for (int tileY = 0; tileY < PM_CHUNK_TILES; tileY++)
+        for (int tileX = 0; tileX < PM_CHUNK_TILES; tileX++)
+            ensure_pm_tile(cache, *chunk, tileX * PM_TILE_SIZE, tileY * PM_TILE_SIZE);
+}
+
+void precalc_pm_cache(PmCache &cache) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.chunks.clear();
+    cache.lru.clear();
+    cache.tilesBuilt = 0;
+}
+
+/* -------------------------
+ *       Cache Builder
+ * -------------------------
+*/
+
+PmCache *pmCacheBuffers[2];
+std::atomic<PmCache*> pmCacheFront { nullptr };
+// the buffer the current frame reads from, the builder never writes into it
+std::atomic<PmCache*> pmCacheInUse { nullptr };
+std::atomic<uint64_t> pmCacheGeneration { 0 };
+
+struct PmCacheBuilder {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool pending { false };
+    std::atomic<bool> quit { false };
+    std::vector<Drawable*> statics;
+    std::deque<uint64_t> prefetch;
+} pmCacheBuilder;
+
+PmCache* acquire_pm_cache() {
+    PmCache *cache;
+    do {
+        cache = pmCacheFront.load();
+        pmCacheInUse.store(cache);
+    } while (pmCacheFront.load() != cache);
+    return cache;
+}
+
+void rebuild_pm_cache(std::vector<Drawable*> &statics) {
+    PmCache *back = pmCacheFront.load() == pmCacheBuffers[0] ? pmCacheBuffers[1] : pmCacheBuffers[0];
+    // the render loop may still be reading the old front of the previous swap
+    while (pmCacheInUse.load() == back && !pmCacheBuilder.quit)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    back->statics = std::move(statics);
+    precalc_pm_cache(*back);
+    back->generation = ++pmCacheGeneration;
+    PmCache *old = pmCacheFront.exchange(back);
+    if (old) {
+        std::lock_guard<std::mutex> lock(old->mutex);
+        printf("\ncache generation %llu published, generation %llu used %u tiles in %zu chunks\n",
+            static_cast<unsigned long long>(back->generation), static_cast<unsigned long long>(old->generation),
+            old->tilesBuilt.load(), old->chunks.size());
+    }
+}
+
+void pm_cache_builder_loop() {
+    while (1) {
+        std::vector<Drawable*> statics;
+        bool rebuild { false };
+        uint64_t prefetch { 0 };
+        {
+            std::unique_lock<std::mutex> lock(pmCacheBuilder.mutex);
+            pmCacheBuilder.wake.wait(lock, [] {
+                return pmCacheBuilder.pending || pmCacheBuilder.quit || !pmCacheBuilder.prefetch.empty();
+            });
+            if (pmCacheBuilder.quit)
+                return;
+            // rebuilds go first, a prefetch into a cache about to be replaced is wasted
+            if (pmCacheBuilder.pending) {
+                rebuild = true;
+                pmCacheBuilder.pending = false;
+                statics.swap(pmCacheBuilder.statics);
+            } else {
+                prefetch = pmCacheBuilder.prefetch.front();
+                pmCacheBuilder.prefetch.pop_front();
+            }
+        }
+
+        if (rebuild) {
+            rebuild_pm_cache(statics);
+        } else if (PmCache *front = pmCacheFront.load()) {
+            // only this thread resets buffers, so the front stays valid while we fill it
+            prefetch_pm_chunk(*front, static_cast<int32_t>(prefetch >> 32), static_cast<int32_t>(prefetch & 0xffffffff));
+        }
+    }
+}
+
+void start_pm_cache_builder() {
+    pmCacheBuffers[0] = new PmCache;
+    pmCacheBuffers[1] = new PmCache;
+    pmCacheBuilder.thread = std::thread(pm_cache_builder_loop);
+}
+void request_pm_cache_rebuild() {
+    {
+        std::lock_guard<std::mutex> lock(pmCacheBuilder.mutex);
+        pmCacheBuilder.pending = true;
+        pmCacheBuilder.statics = drawables;
+        pmCacheBuilder.prefetch.clear();
+    }
+    pmCacheBuilder.wake.notify_one();
+}
+void request_pm_cache_prefetch(vec2 pos) {
+    pos = pos * PM_CACHE_PRECISION;
+    int32_t chunkX { floor_div(static_cast<int64_t>(floor(pos.x)), PM_CHUNK_SIZE) };
+    int32_t chunkY { floor_div(static_cast<int64_t>(floor(pos.y)), PM_CHUNK_SIZE) };
+    PmCache *front = pmCacheFront.load();
+    {
+        std::lock_guard<std::mutex> lock(pmCacheBuilder.mutex);
+        for (int32_t y = chunkY - 1; y <= chunkY + 1; y++) {
+            for (int32_t x = chunkX - 1; x <= chunkX + 1; x++) {
+                uint64_t key { get_pm_chunk_key(x, y) };
+                if (std::find(pmCacheBuilder.prefetch.begin(), pmCacheBuilder.prefetch.end(), key) != pmCacheBuilder.prefetch.end())
+                    continue;
+                if (front) {
+                    std::lock_guard<std::mutex> cacheLock(front->mutex);
+                    if (front->chunks.count(key))
+                        continue;
+                }
+                if (pmCacheBuilder.prefetch.size() >= PM_PREFETCH_QUEUE)
+                    pmCacheBuilder.prefetch.pop_front();
+                pmCacheBuilder.prefetch.push_back(key);
+            }
+        }
+    }
+    pmCacheBuilder.wake.notify_one();
+}
+void stop_pm_cache_builder() {
+    {
+        std::lock_guard<std::mutex> lock(pmCacheBuilder.mutex);
+        pmCacheBuilder.quit = true;
+    }
+    pmCacheBuilder.wake.notify_one();
+    pmCacheBuilder.thread.join();
+    delete pmCacheBuffers[0];
+    delete pmCacheBuffers[1];
+}
+
+bool march_ray_cache(PmCache &cache, vec2 pos, vec2 delta, RayHitInfo* hit, Bounds bounds, float maxDepth, float threshold, uint16_t maxSteps, float penumbra) {
+    float min;
+    int depth { 0 };
+    delta.normalize();
+    vec2 origin = pos;
+    float exit { std::max(std::min(exit_distance(pos, delta, bounds), maxDepth), 0.f) };
+    hit->hit = false;
+    hit->distance = 0;
+    hit->shade = 1;
+    hit->shadeDistance = 0;
+    float lastMin { INFINITY };
+    do {
+        // static layer from the cache, refined exactly near a surface
+        hit->drawable = pm_d_cache(cache, pos);
+        min = pm_cache(cache, pos);
+        if (min <= 1.5f / PM_CACHE_PRECISION) {
+            min = hit->drawable->sdf(pos);
+            // min = get_min_dist(pos);
+        }
+        // dynamic layer is always exact
+        min = dynamicLayer.min_dist(pos, min, &hit->drawable);
+        if (min <= threshold) {
+            hit->hit = true;
+            break;
+        }
+        // grazes as in march_ray
+        if (penumbra > 0 && min > lastMin && hit->distance > lastMin && penumbra * lastMin < hit->shade * (hit->distance - lastMin)) {
+            hit->shade = penumbra * lastMin / (hit->distance - lastMin);
+            hit->shadeDistance = hit->distance - lastMin;
+        }
+        lastMin = min;
+        pos = pos + delta * min;
+        hit->distance += min;
+        depth++;
+    } while (depth < maxSteps && hit->distance < exit && min >= threshold);
+    if (hit->distance > exit) {
+        hit->distance = exit;
+        pos = origin + delta * exit;
+    }
+    hit->pos = pos;
+    return hit->hit;
+}
+
+vec2 march_ray_light(vec2 pos, vec2 delta, Bounds bounds, float threshold) {
+    float min;
+    int depth { 0 };
+    do {
+        min = get_min_dist(pos, nullptr);
+        if (min <= threshold) {
+            break;
+        }
+        pos = pos + delta.normalized() * min;
+        depth++;
+    } while (depth < LIGHT_RAY_MAX_DEPTH && bounds.contains(pos) && min >= threshold);
+    //SDL_RenderDrawLine(renderer, (pos.x > WINDOW_WIDTH) ? WINDOW_WIDTH : pos.x, (pos.y > WINDOW_HEIGHT) ? WINDOW_HEIGHT : pos.y, origin.x, origin.y);
+    return pos;
+}
+
+void push_polygon_point(Polygon &polygon, vec2 screen) {
+    polygon.posX.push_back(clip(screen.x, -INT16_MAX, INT16_MAX));
+    polygon.posY.push_back(clip(screen.y, -INT16_MAX, INT16_MAX));
+}
+
+float polygonSimplifyTolerance { POLYGON_SIMPLIFY_TOLERANCE };
+float polygonSimplifyDpTolerance { POLYGON_SIMPLIFY_DP_TOLERANCE };
+
+float cross(vec2 a, vec2 b) {
+    return a.x * b.y - a.y * b.x;
+}
+float segment_distance(vec2 p, vec2 a, vec2 b) {
+    vec2 ab = b - a;
+    float len = ab.sqr_mag();
+    if (len == 0)
+        return (p - a).magnitude();
+    float t = clip((p - a) * ab / len, 0, 1);
+    return (p - (a + ab * t)).magnitude();
+}
+
+void PolygonSimplifier::douglas_peucker() {
+    if (points.size() < 4)
+        return;
+    static thread_local std::vector<uint8_t> keep;
+    static thread_local std::vector<std::pair<size_t, size_t>> stack;
+    keep.assign(points.size(), 0);
+    keep.front() = keep.back() = 1;
+    stack.clear();
+    stack.push_back({ 0, points.size() - 1 });
+    while (!stack.empty()) {
+        auto range = stack.back();
+        stack.pop_back();
+        float worst { 0 };
+        size_t worstIndex { 0 };
+        for (size_t i = range.first + 1; i < range.second; i++) {
+            float dist = segment_distance(points[i], points[range.first], points[range.second]);
+            if (dist > worst) {
+                worst = dist;
+                worstIndex = i;
+            }
+        }
+        if (worst > polygonSimplifyDpTolerance) {
+            keep[worstIndex] = 1;
+            stack.push_back({ range.first, worstIndex });
+            stack.push_back({ worstIndex, range.second });
+        }
+    }
+    size_t kept { 0 };
+    for (size_t i = 0; i < points.size(); i++) {
+        if (keep[i]) {
+            points[kept] = points[i];
+            values[kept] = values[i];
+            kept++;
+        }
+    }
+    points.resize(kept);
+    values.resize(kept);
+}
+
+bool visible_directions(vec2 pos, Bounds view, int *first, int *count) {
+    if (view.contains(pos)) {
+        *first = 0;
+        *count = LIGHT_DIR_COUNT;
+        return true;
+    }
+    // angles of the view corners around the direction towards its centre
+    vec2 centre = (view.min + view.max) / 2;
+    float centreAngle = atan2f(centre.y - pos.y, centre.x - pos.x);
+    vec2 corners[4] { view.min, { view.max.x, view.min.y }, view.max, { view.min.x, view.max.y } };
+    float lo { 0 }, hi { 0 };
+    for (auto corner : corners) {
+        float angle = atan2f(corner.y - pos.y, corner.x - pos.x) - centreAngle;
+        if (angle > PI) angle -= 2 * PI;
+        if (angle < -PI) angle += 2 * PI;
+        lo = std::min(lo, angle);
+        hi = std::max(hi, angle);
+    }
+    int start = static_cast<int>(floorf((centreAngle + lo) / (2 * PI) * LIGHT_DIR_COUNT));
+    int end = static_cast<int>(ceilf((centreAngle + hi) / (2 * PI) * LIGHT_DIR_COUNT));
+    *first = ((start % LIGHT_DIR_COUNT) + LIGHT_DIR_COUNT) % LIGHT_DIR_COUNT;
+    *count = std::min(end - start + 1, LIGHT_DIR_COUNT);
+    return *count > 0;
+}
+
+float light_intensity(Light *l, float distance) {
+    return clip(1 - distance / light_radius(l), 0, 1);
+}
+float light_radius(const Light *l) {
+    return l->brightness * LIGHT_FALLOFF_PER_BRIGHTNESS;
+}
+float light_lod_density(const Light *l, const Camera &camera) {
+    return std::min(2 * PI * light_radius(l) * camera.zoom / LIGHT_RAY_SPACING / LIGHT_DIR_COUNT, 1.);
+}
+bool light_reaches_view(const Light *l, Bounds view) {
+    vec2 nearest = { clip(l->pos.x, view.min.x, view.max.x), clip(l->pos.y, view.min.y, view.max.y) };
+    return (l->pos - nearest).sqr_mag() <= light_radius(l) * light_radius(l);
+}
+
+// picks the directions of the light that are marched this frame, false if it doesn't reach the view
+bool setup_light_job(LightJob &job, Light *l, const Camera &camera, LightQuality quality) {
+    Bounds view = camera.view();
+    if (!light_reaches_view(l, view) || !visible_directions(l->pos, view, &job.first, &job.count))
+        return false;
+    job.light = l;
+    job.quality = quality;
+    // a light outside the view only covers a wedge, its tip closes the polygon
+    job.closed = job.count == LIGHT_DIR_COUNT;
+    job.marched = static_cast<int>(clip(roundf(job.count * light_lod_density(l, camera) * quality.density), 1, job.count));
+    job.radius = light_radius(l);
+    job.points.resize(job.marched);
+    job.values.resize(job.marched);
+    job.inner.resize(job.marched);
+    job.shades.resize(job.marched);
+    job.depths.resize(job.marched);
+    job.shadeDepths.resize(job.marched);
+    return true;
+}
+// marches the rays begin to end of the light's marched directions into its slice
+void march_light_rays(LightJob &job, PmCache *cache, const Camera &camera, int begin, int end) {
+    Bounds view = camera.view();
+    for (int k = begin; k < end; k++) {
+        int i = (job.first + static_cast<int>(static_cast<int64_t>(k) * job.count / job.marched)) % LIGHT_DIR_COUNT;
+        RayHitInfo hit;
+        // without a published cache yet, march against the exact distances
+        if (cache)
+            march_ray_cache(*cache, job.light->pos, light_directions[i], &hit, view, job.radius, 0.01f, job.quality.maxSteps, job.light->penumbra);
+        else
+            march_ray(job.light->pos, light_directions[i], &hit, view, job.radius, 0.01f, job.quality.maxSteps, job.light->penumbra);
+        job.points[k] = camera.to_screen(hit.pos);
+        job.values[k] = light_intensity(job.light, hit.distance);
+        job.shades[k] = hit.shade;
+        job.inner[k] = hit.shade < 1 ? camera.to_screen(job.light->pos + light_directions[i] * hit.shadeDistance) : job.points[k];
+        job.depths[k] = hit.distance;
+        job.shadeDepths[k] = hit.shade < 1 ? hit.shadeDistance : hit.distance;
+    }
+}
+// whether the ray ends in penumbra or next to one that does, around a closed light the first and
+// last rays are neighbours
+bool in_penumbra(const LightJob &job, int k) {
+    for (int i = k - 1; i <= k + 1; i++) {
+        int ray { i };
+        if (ray < 0 || ray >= job.marched) {
+            if (!job.closed)
+                continue;
+            ray = (ray + job.marched) % job.marched;
+        }
+        if (job.shades[ray] < 1)
+            return true;
+    }
+    return false;
+}
+// the ends of penumbra rays are kept as they are, the soft bands share them with the outline
+void simplify_light(const LightJob &job, const Camera &camera, bool fan, PolygonSimplifier &simplifier) {
+    simplifier.begin();
+    if (!job.closed && !fan)
+        simplifier.push(camera.to_screen(job.light->pos), 1);
+    bool area { job.light->penumbra > 0 };
+    for (int k = 0; k < job.marched; k++) {
+        if (area && in_penumbra(job, k))
+            simplifier.keep(job.points[k], job.values[k]);
+        else
+            simplifier.push(job.points[k], job.values[k]);
+    }
+    simplifier.end(job.closed || !fan);
+}
+
+bool trace_light(PmCache *cache, Light *l, const Camera &camera, bool fan, PolygonSimplifier &simplifier, bool *closed,
+    LightQuality quality, int *rays) {
+    static thread_local LightJob job;
+    if (!setup_light_job(job, l, camera, quality))
+        return false;
+    march_light_rays(job, cache, camera, 0, job.marched);
+    simplify_light(job, camera, fan, simplifier);
+    *closed = job.closed;
+    if (rays)
+        *rays = job.marched;
+    return true;
+}
+
+/* -------------------------
+ *      Quality Governor
+ * -------------------------
+*/
+
+QualityGovernor qualityGovernor;
+
+// rays the lights march if every one takes the given share of its directions, scaled by its weight
+float planned_rays(const QualityGovernor &governor, float share) {
+    float rays { 0 };
+    for (size_t i = 0; i < governor.counts.size(); i++)
+        rays += clip(share * governor.weights[i], QUALITY_MIN_DENSITY, 1) * governor.counts[i];
+    return rays;
+}
+
+void plan_light_quality(QualityGovernor &governor, const Camera &camera, std::vector<LightQuality> &quality) {
+    quality.assign(lights.size(), LIGHT_FULL_QUALITY);
+    if (!governor.enabled || governor.msPerRay <= 0)
+        return;
+
+    Bounds view = camera.view();
+    vec2 centre = (view.min + view.max) / 2;
+    float radius = ((view.max - view.min) / 2).magnitude();
+    governor.counts.resize(lights.size());
+    governor.weights.resize(lights.size());
+    float minWeight { INFINITY };
+    for (size_t i = 0; i < lights.size(); i++) {
+        // the rays the light marches at full quality
+        int first, count;
+        if (light_reaches_view(lights[i], view) && visible_directions(lights[i]->pos, view, &first, &count))
+            governor.counts[i] = static_cast<int>(roundf(count * light_lod_density(lights[i], camera)));
+        else
+            governor.counts[i] = 0;
+        governor.weights[i] = lights[i]->priority / (1 + (lights[i]->pos - centre).magnitude() / radius);
+        if (governor.counts[i] > 0)
+            minWeight = std::min(minWeight, governor.weights[i]);
+    }
+
+    // at a share of 1 / minWeight every light marches all of its directions
+    float affordable = governor.budget / governor.msPerRay;
+    if (minWeight == INFINITY || planned_rays(governor, 1 / minWeight) <= affordable)
+        return;
+    // the largest share the budget affords, the planned rays grow with it
+    float lo { 0 }, hi { 1 / minWeight };
+    for (int iteration = 0; iteration < 24; iteration++) {
+        float mid = (lo + hi) / 2;
+        if (planned_rays(governor, mid) <= affordable)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    for (size_t i = 0; i < lights.size(); i++) {
+        float density = clip(lo * governor.weights[i], QUALITY_MIN_DENSITY, 1);
+        quality[i].density = density;
+        quality[i].maxSteps = static_cast<uint16_t>(QUALITY_MIN_STEPS + (LIGHT_RAY_MAX_DEPTH - QUALITY_MIN_STEPS) * density + 0.5f);
+    }
+}
+
+void update_quality_governor(QualityGovernor &governor, double ms, size_t rays) {
+    if (rays == 0)
+        return;
+    double msPerRay { ms / rays };
+    if (governor.msPerRay <= 0)
+        governor.msPerRay = msPerRay;
+    else
+        governor.msPerRay += (msPerRay - governor.msPerRay) * QUALITY_COST_SMOOTHING;
+}
+
+/* -------------------------
+ *       Shadow Maps
+ * -------------------------
+*/
+
+// odd minimax polynomial of atan on [0, 1]
+#define ATAN_C1 0.99997726f
+#define ATAN_C3 -0.33262347f
+#define ATAN_C5 0.19354346f
+#define ATAN_C7 -0.11643287f
+#define ATAN_C9 0.05265332f
+#define ATAN_C11 -0.01172120f
+
+float fast_atan2(float y, float x) {
+    float ax { std::abs(x) }, ay { std::abs(y) };
+    float a { std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f) };
+    float s { a * a };
+    float r { a * (ATAN_C1 + s * (ATAN_C3 + s * (ATAN_C5 + s * (ATAN_C7 + s * (ATAN_C9 + s * ATAN_C11))))) };
+    if (ay > ax)
+        r = static_cast<float>(PI / 2) - r;
+    if (x < 0)
+        r = static_cast<float>(PI) - r;
+    return std::copysign(r, y);
+}
+
+// fractional ray of the map in the direction of the angle, past the last ray if it wasn't marched
+float shadow_map_ray(const ShadowMap &map, float angle) {
+    float direction { angle * static_cast<float>(LIGHT_DIR_COUNT / (2 * PI)) - map.first };
+    direction -= floorf(direction / LIGHT_DIR_COUNT) * LIGHT_DIR_COUNT;
+    return direction * map.depths.size() / map.count;
+}
+// visibility at the fractional ray t, distance away from the light in world units
+float shadow_map_at(const ShadowMap &map, float t, float distance) {
+    int rays { static_cast<int>(map.depths.size()) };
+    if (!map.closed && t > rays - 1)
+        return 0;
+    int k { std::min(static_cast<int>(t), rays - 1) };
+    float f { std::min(t - k, 1.f) };
+    int next { k + 1 < rays ? k + 1 : map.closed ? 0 : k };
+    if (distance > interpolate(map.depths[k], map.depths[next], f))
+        return 0;
+    if (map.shades.empty() || distance < interpolate(map.shadeDepths[k], map.shadeDepths[next], f))
+        return 1;
+    return interpolate(map.shades[k], map.shades[next], f);
+}
+
+float shadow_visibility(const ShadowMap &map, vec2 pos) {
+    vec2 offset = pos - map.pos;
+    return shadow_map_at(map, shadow_map_ray(map, fast_atan2(offset.y, offset.x)), offset.magnitude());
+}
+
+#ifdef SHADOW_MAP_SSE2
+inline __m128 select_lanes(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+// fast_atan2 in four lanes
+inline __m128 atan2_lanes(__m128 y, __m128 x) {
+    const __m128 sign = _mm_set1_ps(-0.f);
+    __m128 ax = _mm_andnot_ps(sign, x);
+    __m128 ay = _mm_andnot_ps(sign, y);
+    __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_add_ps(_mm_set1_ps(ATAN_C9), _mm_mul_ps(s, _mm_set1_ps(ATAN_C11)));
+    r = _mm_add_ps(_mm_set1_ps(ATAN_C7), _mm_mul_ps(s, r));
+    r = _mm_add_ps(_mm_set1_ps(ATAN_C5), _mm_mul_ps(s, r));
+    r = _mm_add_ps(_mm_set1_ps(ATAN_C3), _mm_mul_ps(s, r));
+    r = _mm_mul_ps(a, _mm_add_ps(_mm_set1_ps(ATAN_C1), _mm_mul_ps(s, r)));
+    r = select_lanes(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(static_cast<float>(PI / 2)), r), r);
+    r = select_lanes(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(static_cast<float>(PI)), r), r);
+    return _mm_or_ps(r, _mm_and_ps(y, sign));
+}
+// values[index[i]] in lane i, SSE2 has no gather
+inline __m128 gather_lanes(const float *values, const int *index) {
+    return _mm_setr_ps(values[index[0]], values[index[1]], values[index[2]], values[index[3]]);
+}
+#endif
+
+void shadow_row(const ShadowMap &map, float dx, float dy, int n, float pixelsPerUnit, float *visibility) {
+    float unitsPerPixel { 1 / pixelsPerUnit };
+    int i { 0 };
+#ifdef SHADOW_MAP_SSE2
+    float rays { static_cast<float>(map.depths.size()) };
+    const __m128 steps = _mm_setr_ps(0, 1, 2, 3);
+    const __m128 y = _mm_set1_ps(dy);
+    const __m128 toDirection = _mm_set1_ps(static_cast<float>(LIGHT_DIR_COUNT / (2 * PI)));
+    const __m128 first = _mm_set1_ps(static_cast<float>(map.first));
+    const __m128 directions = _mm_set1_ps(LIGHT_DIR_COUNT);
+    const __m128 toRay = _mm_set1_ps(rays / map.count);
+    const __m128 last = _mm_set1_ps(rays - 1);
+    const __m128 one = _mm_set1_ps(1);
+    alignas(16) int k[4], next[4];
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_add_ps(_mm_set1_ps(dx + i), steps);
+        __m128 distance = _mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))), _mm_set1_ps(unitsPerPixel));
+        // directions from first on, shifted positive so truncating floors them
+        __m128 direction = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(atan2_lanes(y, x), toDirection), first), _mm_add_ps(directions, directions));
+        direction = _mm_sub_ps(direction, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(direction, directions))), directions));
+        __m128 t = _mm_mul_ps(direction, toRay);
+        __m128 valid = map.closed ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_cmple_ps(t, last);
+        __m128 ray = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_min_ps(t, last)));
+        __m128 f = _mm_min_ps(_mm_sub_ps(t, ray), one);
+        __m128 nextRay = _mm_add_ps(ray, one);
+        nextRay = map.closed ? _mm_andnot_ps(_mm_cmpgt_ps(nextRay, last), nextRay) : _mm_min_ps(nextRay, last);
+        _mm_store_si128(reinterpret_cast<__m128i*>(k), _mm_cvttps_epi32(ray));
+        _mm_store_si128(reinterpret_cast<__m128i*>(next), _mm_cvttps_epi32(nextRay));
+
+        __m128 depth = gather_lanes(map.depths.data(), k);
+        depth = _mm_add_ps(depth, _mm_mul_ps(_mm_sub_ps(gather_lanes(map.depths.data(), next), depth), f));
+        __m128 lit = _mm_and_ps(valid, _mm_cmple_ps(distance, depth));
+        __m128 light = _mm_and_ps(lit, one);
+        if (!map.shades.empty() && _mm_movemask_ps(lit)) {
+            __m128 shadeDepth = gather_lanes(map.shadeDepths.data(), k);
+            shadeDepth = _mm_add_ps(shadeDepth, _mm_mul_ps(_mm_sub_ps(gather_lanes(map.shadeDepths.data(), next), shadeDepth), f));
+            __m128 shade = gather_lanes(map.shades.data(), k);
+            shade = _mm_add_ps(shade, _mm_mul_ps(_mm_sub_ps(gather_lanes(map.shades.data(), next), shade), f));
+            light = _mm_and_ps(lit, select_lanes(_mm_cmplt_ps(distance, shadeDepth), one, shade));
+        }
+        _mm_storeu_ps(visibility + i, light);
+    }
+#endif
+    for (; i < n; i++) {
+        float x { dx + i };
+        visibility[i] = shadow_map_at(map, shadow_map_ray(map, fast_atan2(dy, x)), sqrtf(x * x + dy * dy) * unitsPerPixel);
+    }
+}
+
+/* -------------------------
+ *      Frame Pipeline
+ * -------------------------
+*/
+
+FramePipeline framePipeline;
+
+void trace_frame(FrameTrace &frame, PmCache *cache, const Camera &camera, bool fan) {
+    auto start = std::chrono::steady_clock::now();
+    frame.camera = camera;
+    frame.fan = fan;
+    plan_light_quality(qualityGovernor, camera, frame.quality);
+    march_lights(frame, cache, camera, fan);
+    frame.marchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    update_quality_governor(qualityGovernor, frame.marchMs, frame.rays);
+}
+
+// the band between two penumbra rays, from where they grazed an occluder to their ends, which are
+// vertices of the light's outline as well
+void splat_penumbra_band(HdrBuffer &hdr, int splat, const PenumbraRay &a, const PenumbraRay &b, float scale) {
+    vec2 corners[4] { a.inner * scale, a.outer * scale, b.outer * scale, b.inner * scale };
+    float shades[4] { a.shade - 1, a.shade - 1, b.shade - 1, b.shade - 1 };
+    // split along the diagonal inside the quad, it may be concave where a ray grazed early
+    int d { cross(corners[2] - corners[0], corners[1] - corners[0]) * cross(corners[2] - corners[0], corners[3] - corners[0]) <= 0 ? 0 : 1 };
+    hdr_splat_triangle(hdr, splat, corners[d], corners[d + 1], corners[d + 2], shades[d], shades[d + 1], shades[d + 2]);
+    hdr_splat_triangle(hdr, splat, corners[d], corners[d + 2], corners[(d + 3) % 4], shades[d], shades[d + 2], shades[(d + 3) % 4]);
+}
+
+// green dots on the lights in view
+void draw_light_markers(Framebuffer &fb, const FrameTrace &frame, float scale) {
+    for (size_t i = 0; i < frame.count; i++) {
+        const LightOutline &outline = frame.lights[i];
+        if (outline.inView) {
+            vec2 pos = outline.screenPos * scale;
+            fb_fill_circle(fb, pos.x, pos.y, std::max(static_cast<int>(10 * scale), 1), fb_color(0, 255, 0, 255));
+        }
+    }
+}
+
+void fill_frame(Framebuffer &fb, const FrameTrace &frame, float scale) {
+    static thread_local std::vector<vec2> polygon;
+    static thread_local HdrBuffer hdr;
+    hdr_begin(hdr, fb.width, fb.height);
+    for (size_t i = 0; i < frame.count; i++) {
+        const LightOutline &outline = frame.lights[i];
+        polygon.clear();
+        for (auto point : outline.points)
+            polygon.push_back(point * scale);
+        int splat { hdr_add_splat(hdr, outline.screenPos * scale, outline.radius * scale, outline.radiance) };
+        hdr_splat_polygon(hdr, splat, polygon.data(), polygon.size());
+        // the soft bands take back the share of the light the occluders hide
+        for (size_t k = 1; k < outline.penumbra.size(); k++) {
+            if (!outline.penumbra[k].joined)
+                continue;
+            splat_penumbra_band(hdr, splat, outline.penumbra[k - 1], outline.penumbra[k], scale);
+        }
+    }
+    hdr_resolve(hdr, fb, fb_color(DEF_BG_COL_R, DEF_BG_COL_G, DEF_BG_COL_B, DEF_BG_COL_A));
+    draw_light_markers(fb, frame, scale);
+}
+
+void shade_frame(Framebuffer &fb, const FrameTrace &frame, float scale) {
+    static thread_local HdrBuffer hdr;
+    hdr_begin(hdr, fb.width, fb.height);
+    for (size_t i = 0; i < frame.count; i++) {
+        const LightOutline &outline = frame.lights[i];
+        hdr_splat_disc(hdr, hdr_add_splat(hdr, outline.screenPos * scale, outline.radius * scale, outline.radiance, &outline.shadow));
+    }
+    hdr_resolve(hdr, fb, fb_color(DEF_BG_COL_R, DEF_BG_COL_G, DEF_BG_COL_B, DEF_BG_COL_A));
+    draw_light_markers(fb, frame, scale);
+}
+
+const ShadowMap* find_shadow_map(const FrameTrace &frame, const Light *l) {
+    for (size_t i = 0; i < frame.count; i++)
+        if (frame.lights[i].shadow.light == l)
+            return &frame.lights[i].shadow;
+    return nullptr;
+}
+
+void frame_pipeline_loop() {
+    while (1) {
+        int back;
+        PmCache *cache;
+        Camera camera;
+        bool fan;
+        {
+            std::unique_lock<std::mutex> lock(framePipeline.mutex);
+            framePipeline.wake.wait(lock, [] {
+                return framePipeline.pending || framePipeline.quit;
+            });
+            if (framePipeline.quit)
+                return;
+            framePipeline.pending = false;
+            back = framePipeline.back;
+            cache = framePipeline.cache;
+            camera = framePipeline.camera;
+            fan = framePipeline.fan;
+        }
+
+        trace_frame(framePipeline.frames[back], cache, camera, fan);
+
+        {
+            std::lock_guard<std::mutex> lock(framePipeline.mutex);
+            framePipeline.busy = false;
+        }
+        framePipeline.done.notify_one();
+    }
+}
+
+void start_frame_pipeline() {
+    framePipeline.thread = std::thread(frame_pipeline_loop);
+}
+void submit_frame_trace(PmCache *cache, const Camera &camera, bool fan) {
+    {
+        std::lock_guard<std::mutex> lock(framePipeline.mutex);
+        // the previous buffer is the one the fill stage may still be reading
+        framePipeline.back ^= 1;
+        framePipeline.cache = cache;
+        framePipeline.camera = camera;
+        framePipeline.fan = fan;
+        framePipeline.submitted = true;
+        framePipeline.pending = true;
+        framePipeline.busy = true;
+    }
+    framePipeline.wake.notify_one();
+}
+FrameTrace* wait_frame_trace() {
+    std::unique_lock<std::mutex> lock(framePipeline.mutex);
+    if (!framePipeline.submitted)
+        return nullptr;
+    framePipeline.done.wait(lock, [] {
+        return !framePipeline.busy;
+    });
+    return &framePipeline.frames[framePipeline.back];
+}
+void stop_frame_pipeline() {
+    {
+        std::lock_guard<std::mutex> lock(framePipeline.mutex);
+        framePipeline.quit = true;
+    }
+    framePipeline.wake.notify_one();
+    framePipeline.thread.join();
+}
+
+bool fb_write_ppm(const Framebuffer &fb, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    fprintf(file, "P6\n%d %d\n255\n", fb.width, fb.height);
+    std::vector<uint8_t> row(static_cast<size_t>(fb.width) * 3);
+    for (int y = 0; y < fb.height; y++) {
+        const uint32_t *src = fb.pixels.data() + static_cast<size_t>(y) * fb.width;
+        for (int x = 0; x < fb.width; x++) {
+            row[x * 3] = src[x] >> 16 & 0xff;
+            row[x * 3 + 1] = src[x] >> 8 & 0xff;
+            row[x * 3 + 2] = src[x] & 0xff;
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+/* -------------------------
+ *    Visibility Engines
+ * -------------------------
+*/
+
+std::atomic<VisibilityEngine> visibilityEngine { VISIBILITY_MARCH };
+
+// the static clearance at pos from the nearest cache texel alone, one lookup instead of the four
+// of pm_cache. Near a surface it is exact, the texel's drawable decides.
+inline float polar_sample(PmCache &cache, vec2 pos) {
+    vec2 texel = pos * PM_CACHE_PRECISION;
+    uint64_t index;
+    PmChunk *chunk = pm_texel(cache, static_cast<int64_t>(floorf(texel.x + 0.5f)), static_cast<int64_t>(floorf(texel.y + 0.5f)), &index);
+    float min { chunk->distances[index] };
+    // the texel is up to half a diagonal away from pos
+    if (min <= (1.5f + 0.71f) / PM_CACHE_PRECISION && chunk->drawables[index])
+        min = chunk->drawables[index]->sdf(pos);
+    return min;
+}
+
+void polar_light_rays(LightJob &job, PmCache &cache, const Camera &camera, int begin, int end) {
+    // one column per direction, the rings are reduced into them as they are sampled
+    struct Column {
+        vec2 dir;
+        float exit;
+        float depth;
+        // clearance of the last ring, a graze is where it stops shrinking
+        float last;
+        float shade, shadeDepth;
+        // the dynamic layer is exact, it can't be hit before the ring it last reported as clear
+        float dynamicFrom;
+        bool open;
+    };
+    static thread_local std::vector<Column> columns;
+    Bounds view = camera.view();
+    vec2 origin = job.light->pos;
+    float penumbra { job.light->penumbra };
+    columns.resize(end - begin);
+    int open { 0 };
+    for (int k = begin; k < end; k++) {
+        int i = (job.first + static_cast<int>(static_cast<int64_t>(k) * job.count / job.marched)) % LIGHT_DIR_COUNT;
+        float exit { std::max(std::min(exit_distance(origin, light_directions[i], view), job.radius), 0.f) };
+        columns[k - begin] = { light_directions[i], exit, exit, INFINITY, 1, exit, 0, true };
+        open++;
+    }
+
+    for (int ring = 0; open > 0; ring++) {
+        float r { ring * POLAR_RING_STEP };
+        for (Column &column : columns) {
+            if (!column.open)
+                continue;
+            if (r >= column.exit) {
+                column.open = false;
+                open--;
+                continue;
+            }
+            vec2 pos = origin + column.dir * r;
+            float min { polar_sample(cache, pos) };
+            // area lights need the clearance of every ring for their grazes
+            if (penumbra > 0 || r >= column.dynamicFrom) {
+                Drawable *drawable;
+                float dynamic { dynamicLayer.min_dist(pos, INFINITY, &drawable) };
+                column.dynamicFrom = r + dynamic;
+                min = std::min(min, dynamic);
+            }
+            if (min <= 0) {
+                // back to where the field puts the surface, not beyond the last ring
+                column.depth = std::max({ r + min, r - POLAR_RING_STEP, 0.f });
+                column.open = false;
+                open--;
+                continue;
+            }
+            // grazes as in march_ray, the last ring was a local minimum of the clearance
+            float lastR { r - POLAR_RING_STEP };
+            if (penumbra > 0 && min > column.last && lastR > column.last && penumbra * column.last < column.shade * lastR) {
+                column.shade = penumbra * column.last / lastR;
+                column.shadeDepth = lastR;
+            }
+            column.last = min;
+        }
+    }
+
+    for (int k = begin; k < end; k++) {
+        const Column &column = columns[k - begin];
+        vec2 hit = origin + column.dir * column.depth;
+        job.points[k] = camera.to_screen(hit);
+        job.values[k] = light_intensity(job.light, column.depth);
+        job.shades[k] = column.shade;
+        job.inner[k] = column.shade < 1 ? camera.to_screen(origin + column.dir * column.shadeDepth) : job.points[k];
+        job.depths[k] = column.depth;
+        job.shadeDepths[k] = column.shade < 1 ? column.shadeDepth : column.depth;
+    }
+}
+
+/* -------------------------
+ *        Light Queue
+ * -------------------------
+*/
+
+LightQueue lightQueue;
+
+// keeps the rays of an area light that end in penumbra and their neighbours, which close the
+// soft band towards the fully lit rays
+void collect_penumbra(const LightJob &job, std::vector<PenumbraRay> &penumbra) {
+    penumbra.clear();
+    int n { job.marched };
+    int first { -1 }, last { -2 };
+    for (int k = 0; k < n; k++) {
+        if (!in_penumbra(job, k))
+            continue;
+        penumbra.push_back({ job.inner[k], job.points[k], job.shades[k], last == k - 1 });
+        if (first < 0)
+            first = k;
+        last = k;
+    }
+    // around a closed light the band may run on over the first ray
+    if (job.closed && n > 1 && first == 0 && last == n - 1) {
+        penumbra.push_back(penumbra.front());
+        penumbra.back().joined = true;
+    }
+}
+
+void march_light_work(const LightWork &work) {
+    LightQueue &queue = lightQueue;
+    static thread_local PolygonSimplifier simplifier;
+    LightJob &job = queue.jobs[work.job];
+    if (queue.engine == VISIBILITY_POLAR && queue.cache)
+        polar_light_rays(job, *queue.cache, queue.camera, work.begin, work.end);
+    else
+        march_light_rays(job, queue.cache, queue.camera, work.begin, work.end);
+    if (job.remaining.fetch_sub(1) != 1)
+        return;
+
+    // every ray of the light is in, the slices of the other workers included
+    simplify_light(job, queue.camera, queue.fan, simplifier);
+    LightOutline &outline = queue.frame->lights[job.outline];
+    outline.points.assign(simplifier.points.begin(), simplifier.points.end());
+    outline.values.assign(simplifier.values.begin(), simplifier.values.end());
+    outline.closed = job.closed;
+    if (job.light->penumbra > 0)
+        collect_penumbra(job, outline.penumbra);
+    else
+        outline.penumbra.clear();
+    outline.screenPos = queue.camera.to_screen(job.light->pos);
+    outline.inView = queue.camera.view().contains(job.light->pos);
+    outline.radius = job.radius * queue.camera.zoom;
+    float scale { job.light->brightness / HDR_BRIGHTNESS_UNIT };
+    outline.radiance = { job.light->color.r * scale, job.light->color.g * scale, job.light->color.b * scale };
+
+    ShadowMap &shadow = outline.shadow;
+    shadow.light = job.light;
+    shadow.pos = job.light->pos;
+    shadow.radius = job.radius;
+    shadow.first = job.first;
+    shadow.count = job.count;
+    shadow.closed = job.closed;
+    shadow.depths.assign(job.depths.begin(), job.depths.end());
+    if (job.light->penumbra > 0) {
+        shadow.shadeDepths.assign(job.shadeDepths.begin(), job.shadeDepths.end());
+        shadow.shades.assign(job.shades.begin(), job.shades.end());
+    } else {
+        shadow.shadeDepths.clear();
+        shadow.shades.clear();
+    }
+}
+// works off the worker's own queue, then steals from the others until all of them are empty
+void run_light_work(int self) {
+    LightQueue &queue = lightQueue;
+    int queues { static_cast<int>(queue.threads.size()) + 1 };
+    for (int offset = 0; offset < queues; offset++) {
+        LightWorkQueue &from = queue.queues[(self + offset) % queues];
+        int item;
+        while ((item = from.next.fetch_add(1)) < static_cast<int>(from.items.size()))
+            march_light_work(from.items[item]);
+    }
+}
+
+void light_queue_loop(int self) {
+    uint64_t seen { 0 };
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(lightQueue.mutex);
+            lightQueue.wake.wait(lock, [&seen] {
+                return lightQueue.pass != seen || lightQueue.quit;
+            });
+            if (lightQueue.quit)
+                return;
+            seen = lightQueue.pass;
+            lightQueue.working++;
+        }
+
+        run_light_work(self);
+
+        {
+            std::lock_guard<std::mutex> lock(lightQueue.mutex);
+            lightQueue.working--;
+        }
+        lightQueue.done.notify_all();
+    }
+}
+
+void start_light_queue(int threads) {
+    if (threads <= 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    threads = std::min(threads, LIGHT_QUEUE_MAX_THREADS);
+    for (int i = 0; i < threads; i++)
+        lightQueue.threads.emplace_back(light_queue_loop, i + 1);
+}
+void march_lights(FrameTrace &frame, PmCache *cache, const Camera &camera, bool fan) {
+    LightQueue &queue = lightQueue;
+    {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        // a worker that woke up too late for the last frame may still be looking for items
+        queue.done.wait(lock, [] {
+            return lightQueue.working == 0;
+        });
+        frame.count = 0;
+        frame.rays = 0;
+        queue.jobCount = 0;
+        for (size_t k = 0; k < lights.size(); k++) {
+            if (queue.jobCount == queue.jobs.size())
+                queue.jobs.emplace_back();
+            LightJob &job = queue.jobs[queue.jobCount];
+            if (!setup_light_job(job, lights[k], camera, frame.quality[k]))
+                continue;
+            job.outline = frame.count++;
+            frame.rays += job.marched;
+            queue.jobCount++;
+        }
+        // the outlines are written in place, they must not move while the workers run
+        while (frame.lights.size() < frame.count)
+            frame.lights.emplace_back();
+
+        int queues { static_cast<int>(queue.threads.size()) + 1 };
+        for (int i = 0; i < queues; i++) {
+            queue.queues[i].items.clear();
+            queue.queues[i].next = 0;
+        }
+        int dealt { 0 };
+        for (size_t j = 0; j < queue.jobCount; j++) {
+            LightJob &job = queue.jobs[j];
+            int items { (job.marched + LIGHT_QUEUE_CHUNK - 1) / LIGHT_QUEUE_CHUNK };
+            job.remaining = items;
+            for (int i = 0; i < items; i++)
+                queue.queues[dealt++ % queues].items.push_back(LightWork{ static_cast<int>(j),
+                    i * LIGHT_QUEUE_CHUNK, std::min((i + 1) * LIGHT_QUEUE_CHUNK, job.marched) });
+        }
+        queue.cache = cache;
+        queue.camera = camera;
+        queue.fan = fan;
+        queue.engine = visibilityEngine;
+        queue.frame = &frame;
+        queue.pass++;
+    }
+    queue.wake.notify_all();
+
+    run_light_work(0);
+
+    // every item is taken, wait for the ones still being marched
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.done.wait(lock, [] {
+        return lightQueue.working == 0;
+    });
+}
+void stop_light_queue() {
+    {
+        std::lock_guard<std::mutex> lock(lightQueue.mutex);
+        lightQueue.quit = true;
+    }
+    lightQueue.wake.notify_all();
+    for (auto &thread : lightQueue.threads)
+        thread.join();
+    lightQueue.threads.clear();
+}
+
+/* -------------------------
+ *    Resolution Governor
+ * -------------------------
+*/
+
+ResolutionGovernor resolutionGovernor;
+
+bool update_resolution_governor(ResolutionGovernor &governor, double frameMs) {
+    if (governor.count == RESOLUTION_WINDOW)
+        governor.sum -= governor.times[governor.next];
+    else
+        governor.count++;
+    governor.times[governor.next] = frameMs;
+    governor.sum += frameMs;
+    governor.next = (governor.next + 1) % RESOLUTION_WINDOW;
+    // frames from before the last change don't count
+    if (governor.count < RESOLUTION_WINDOW)
+        return false;
+
+    double mean { governor.sum / governor.count };
+    float scale { governor.scale };
+    if (mean > governor.budget) {
+        // at least one step, further if the pixel count has to drop more than that
+        float fit { scale * static_cast<float>(sqrt(governor.budget / mean)) };
+        fit = floorf(fit / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+        scale = std::max(std::min(fit, scale - RESOLUTION_SCALE_STEP), RESOLUTION_MIN_SCALE);
+    } else if (scale < 1) {
+        // one step up, if the cost it is expected to have still leaves the margin
+        float up { std::min(scale + RESOLUTION_SCALE_STEP, 1.f) };
+        double grown { (up / scale) * (up / scale) };
+        if (mean * grown < governor.budget * RESOLUTION_UP_THRESHOLD)
+            scale = up;
+    }
+    if (scale == governor.scale)
+        return false;
+    governor.scale = scale;
+    governor.count = 0;
+    governor.next = 0;
+    governor.sum = 0;
+    return true;
+}
+void reset_resolution_governor(ResolutionGovernor &governor) {
+    governor.scale = 1;
+    governor.count = 0;
+    governor.next = 0;
+    governor.sum = 0;
+}
+int scaled_size(int size, float scale) {
+    return std::max(static_cast<int>(size * scale + 0.5f), 1);
+}
+
+/* -------------------------
+ *        Field View
+ * -------------------------
+*/
+
+FieldView fieldView;
+
+// bright near a surface and darker further away, with a darker iso line every few units
+uint32_t field_color(float dist) {
+    if (dist <= 0)
+        return fb_color(40, 60, 160, 255);
+    float t { clip(dist / FIELD_VIEW_RANGE, 0, 1) };
+    float shade { fmodf(dist, FIELD_VIEW_ISO_SPACING) < FIELD_VIEW_ISO_SPACING * 0.1f ? 0.6f : 1.f };
+    return fb_color(255 * (1 - 0.7f * t) * shade, 255 * (1 - 0.9f * t) * shade, 255 * (1 - t) * shade, 255);
+}
+// red where the cache is off, over a grey ramp of the exact distance to find one's way
+uint32_t field_error_color(float cached, float exact) {
+    if (exact <= 0)
+        return fb_color(40, 60, 160, 255);
+    float e { clip(std::abs(cached - exact) / FIELD_VIEW_ERROR_RANGE, 0, 1) };
+    float grey { 80 * (1 - clip(exact / FIELD_VIEW_RANGE, 0, 1)) };
+    return fb_color(grey + (255 - grey) * e, grey * (1 - e), grey * (1 - e), 255);
+}
+
+void draw_field_tile(int tile) {
+    FieldView &view = fieldView;
+    int x1 { (tile % view.tilesX) * FIELD_VIEW_TILE_SIZE };
+    int y1 { (tile / view.tilesX) * FIELD_VIEW_TILE_SIZE };
+    int x2 { std::min(x1 + FIELD_VIEW_TILE_SIZE, view.fb->width) };
+    int y2 { std::min(y1 + FIELD_VIEW_TILE_SIZE, view.fb->height) };
+    int n { x2 - x1 };
+    bool cached { view.cache && view.source != FIELD_SOURCE_EXACT };
+    float step { 1 / (view.camera.zoom * view.scale) };
+    float field[FIELD_VIEW_TILE_SIZE];
+    float exact[FIELD_VIEW_TILE_SIZE];
+
+    for (int y = y1; y < y2; y++) {
+        // pixel centres
+        vec2 pos = view.camera.to_world(vec2{ x1 + 0.5f, y + 0.5f } / view.scale);
+        if (!cached || view.source == FIELD_SOURCE_ERROR) {
+            std::fill(exact, exact + n, 10000.f);
+            view.statics.min_dist_row(pos, step, n, exact);
+        }
+        if (cached) {
+            for (int i = 0; i < n; i++)
+                field[i] = pm_cache(*view.cache, pos + vec2{ i * step, 0 });
+        } else {
+            std::copy(exact, exact + n, field);
+        }
+
+        uint32_t *row = view.fb->pixels.data() + static_cast<size_t>(y) * view.fb->width + x1;
+        if (view.source == FIELD_SOURCE_ERROR) {
+            // the cache never holds more than the chunk margin
+            for (int i = 0; i < n; i++)
+                row[i] = field_error_color(field[i], std::min(exact[i], PM_CHUNK_MARGIN));
+            continue;
+        }
+        dynamicLayer.min_dist_row(pos, step, n, field);
+        for (int i = 0; i < n; i++)
+            row[i] = field_color(field[i]);
+    }
+}
+void draw_field_tiles() {
+    int tile;
+    while ((tile = fieldView.nextTile.fetch_add(1)) < fieldView.tileCount)
+        draw_field_tile(tile);
+}
+
+void field_view_loop() {
+    uint64_t seen { 0 };
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(fieldView.mutex);
+            fieldView.wake.wait(lock, [&seen] {
+                return fieldView.job != seen || fieldView.quit;
+            });
+            if (fieldView.quit)
+                return;
+            seen = fieldView.job;
+            fieldView.working++;
+        }
+
+        draw_field_tiles();
+
+        {
+            std::lock_guard<std::mutex> lock(fieldView.mutex);
+            fieldView.working--;
+        }
+        fieldView.done.notify_all();
+    }
+}
+
+void start_field_view(int threads) {
+    if (threads <= 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    threads = std::min(threads, FIELD_VIEW_MAX_THREADS);
+    for (int i = 0; i < threads; i++)
+        fieldView.threads.emplace_back(field_view_loop);
+}
+void draw_field(Framebuffer &fb, PmCache *cache, const Camera &camera, FieldSource source, float scale) {
+    {
+        std::unique_lock<std::mutex> lock(fieldView.mutex);
+        // a worker that woke up too late for the last frame may still be looking for tiles
+        fieldView.done.wait(lock, [] {
+            return fieldView.working == 0;
+        });
+        fieldView.statics.drawables = drawables;
+        fieldView.statics.sync();
+        fieldView.fb = &fb;
+        fieldView.cache = cache;
+        fieldView.camera = camera;
+        fieldView.scale = scale;
+        fieldView.source = source;
+        fieldView.tilesX = (fb.width + FIELD_VIEW_TILE_SIZE - 1) / FIELD_VIEW_TILE_SIZE;
+        fieldView.tileCount = fieldView.tilesX * ((fb.height + FIELD_VIEW_TILE_SIZE - 1) / FIELD_VIEW_TILE_SIZE);
+        fieldView.nextTile = 0;
+        fieldView.job++;
+    }
+    fieldView.wake.notify_all();
+
+    draw_field_tiles();
+
+    // every tile is taken, wait for the ones still being drawn
+    std::unique_lock<std::mutex> lock(fieldView.mutex);
+    fieldView.done.wait(lock, [] {
+        return fieldView.working == 0;
+    });
+}
+void stop_field_view() {
+    {
+        std::lock_guard<std::mutex> lock(fieldView.mutex);
+        fieldView.quit = true;
+    }
+    fieldView.wake.notify_all();
+    for (auto &thread : fieldView.threads)
+        thread.join();
+    fieldView.threads.clear();
+}
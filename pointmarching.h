@@ -0,0 +1,975 @@
+#ifndef POINTMARCHING_H
+#define POINTMARCHING_H
+
+// The marching core: drawables, the pointmarching cache and its builder, the marchers, the
+// visibility polygons and the software framebuffer they are filled into. Nothing in here
+// depends on SDL, so it builds into a library for the window, headless runs and servers alike.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctime>
+#include <vector>
+#include <random>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <list>
+#include <deque>
+#include <unordered_map>
+
+#define PI 3.14159265
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+float clip(float n, float lower, float upper);
+
+typedef struct vec2 {
+    float x, y;
+
+    vec2() : x{0}, y{0} {}
+    vec2(float x, float y) : x{x}, y{y} {}
+    vec2 operator+ (vec2 o) const {
+        return { x + o.x, y + o.y };
+    }
+    vec2 operator- (vec2 o) const {
+        return { x - o.x, y - o.y };
+    }
+    float operator* (vec2 o) const {
+        return x * o.x + y * o.y;
+    }
+    vec2 operator* (float v) const {
+        return { x * v, y * v };
+    }
+    vec2 operator/ (float v) const {
+        return { x / v, y / v };
+    }
+    float magnitude() {
+        return sqrt(*this * *this);
+    }
+    float sqr_mag() {
+        return *this * *this;
+    }
+    vec2 normalized() {
+        if (*this * *this == 1)
+            return *this;
+        else
+            return *this / magnitude();
+    }
+    void normalize() {
+        if (*this * *this == 1)
+            return;
+        *this = *this / magnitude();
+    }
+    vec2 abs() {
+        return { std::abs(x), std::abs(y) };
+    }
+    float max() {
+        return std::max(x, y);
+    }
+    float min() {
+        return std::min(x, y);
+    }
+    static vec2 max(vec2 a, vec2 b) {
+        return { std::max(a.x, b.x), std::max(a.y, b.y) };
+    }
+} vec2;
+
+class Drawable {
+public:
+    vec2 pos;
+    virtual float sdf(vec2 p) {
+        return 0;
+    }
+    Drawable(vec2 pos) : pos{ pos } {}
+    virtual ~Drawable() = default;
+};
+
+class Circle : public Drawable {
+public:
+    float radius;
+    float sdf(vec2 p) override {
+        return (pos - p).magnitude() - radius;
+    }
+    Circle(vec2 pos, float radius) : Drawable{ pos }, radius{ radius } {}
+};
+
+class Rectangle : public Drawable {
+public:
+    vec2 size;
+    float sdf(vec2 p) override {
+        p = pos - p;
+        vec2 d = p.abs() - size / 2;
+        return vec2::max(d, { 0,0 }).magnitude() + std::min(std::max(d.x,d.y),0.f);
+    }
+    Rectangle(vec2 pos, vec2 size) : Drawable{ pos }, size{ size } {}
+};
+
+// how much a light's quality is worth against the others when the frame budget runs short
+#define LIGHT_PRIORITY_DEFAULT 1.f
+#define LIGHT_PRIORITY_PLAYER 1000.f
+
+// linear, 1 is the full channel
+struct LightColor {
+    float r, g, b;
+};
+#define LIGHT_COLOR_WHITE LightColor{ 1, 1, 1 }
+
+class Light : public Drawable {
+public:
+    float brightness;
+    float priority;
+    LightColor color;
+    // hardness k of an area light's soft shadows, 0 for a point light with hard shadows
+    float penumbra { 0 };
+    float sdf(vec2 p) override {
+        return (pos - p).magnitude();
+    }
+    Light(vec2 pos, float brightness, float priority = LIGHT_PRIORITY_DEFAULT, LightColor color = LIGHT_COLOR_WHITE)
+        : Drawable{ pos }, brightness{ brightness }, priority{ priority }, color{ color } {}
+};
+
+
+/* -------------------------
+ *      Rendering Stuff
+ * -------------------------
+*/
+
+#define WINDOW_WIDTH 800
+#define WINDOW_HEIGHT 600
+
+#define DEF_COL_R 0
+#define DEF_COL_G 0
+#define DEF_COL_B 0
+#define DEF_COL_A 255
+
+#define DEF_BG_COL_R 255
+#define DEF_BG_COL_G 150
+#define DEF_BG_COL_B 31
+#define DEF_BG_COL_A 255
+
+// axis aligned box in world space
+struct Bounds {
+    vec2 min, max;
+    bool contains(vec2 p) const {
+        return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y;
+    }
+};
+
+// distance along a normalized ray until it leaves the bounds, entering them first if it starts
+// outside. Returns a negative value if the ray misses the bounds.
+float exit_distance(vec2 pos, vec2 dir, Bounds bounds);
+
+// maps world space to window pixels, world units are no longer tied to the window
+#define CAMERA_PAN_SPEED 400
+#define CAMERA_ZOOM_SPEED 1.5
+#define CAMERA_MIN_ZOOM 0.05f
+#define CAMERA_MAX_ZOOM 8.f
+
+struct Camera {
+    // world position in the middle of the window
+    vec2 pos { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 };
+    // window pixels per world unit
+    float zoom { 1 };
+
+    vec2 to_screen(vec2 world) const {
+        return (world - pos) * zoom + vec2{ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 };
+    }
+    vec2 to_world(vec2 screen) const {
+        return (screen - vec2{ WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 }) / zoom + pos;
+    }
+    // the part of the world that is visible in the window
+    Bounds view() const {
+        return { to_world({ 0, 0 }), to_world({ WINDOW_WIDTH, WINDOW_HEIGHT }) };
+    }
+};
+extern Camera camera;
+
+/* -------------------------
+ *    Software Rendering
+ * -------------------------
+*/
+
+// Instead of one renderer call per point or span, everything is drawn into a pixel buffer
+// we own. The window uploads it once per frame, headless runs write it out as it is.
+
+struct Framebuffer {
+    int width, height;
+    // ARGB8888, row major without padding
+    std::vector<uint32_t> pixels;
+};
+extern Framebuffer framebuffer;
+
+uint32_t fb_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+// blends src over dst with the alpha of src
+uint32_t fb_blend(uint32_t dst, uint32_t src);
+
+void init_framebuffer(Framebuffer &fb, int width, int height);
+void fb_clear(Framebuffer &fb, uint32_t color);
+void fb_point(Framebuffer &fb, int x, int y, uint32_t color);
+// fills [x1, x2] on row y, clipped to the buffer
+void fb_span(Framebuffer &fb, int x1, int x2, int y, uint32_t color);
+void fb_fill_circle(Framebuffer &fb, int cx, int cy, int radius, uint32_t color);
+void fb_fill_polygon(Framebuffer &fb, const int16_t *vx, const int16_t *vy, int n, uint32_t color);
+// writes the buffer as a binary PPM, returns false if the file can't be written
+bool fb_write_ppm(const Framebuffer &fb, const char *path);
+
+/* -------------------------
+ *     HDR Accumulation
+ * -------------------------
+*/
+
+// Lights add up instead of painting over each other. Every light splats its visible region with
+// its colour times its brightness, falling off linearly to nothing at its radius, and a tonemap
+// pass compresses the sum of all lights per channel, L / (1 + L), over the background into the
+// 8 bit framebuffer. The polygons are only scanned into spans at first, sorted into bands of
+// rows. The bands are then resolved one after the other: the spans of all lights are added into
+// a float buffer, one plane per channel, that holds just the band and stays in cache, and the
+// band is tonemapped right away, four pixels per SIMD step in both passes. Spans may carry a
+// shade that changes linearly along them, for triangles that take back part of a light, and a
+// splat may look up at every pixel how much of its light gets there in a shadow map instead.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HDR_SSE2
+#endif
+
+// brightness of a light that adds a radiance of 1 right at the light
+#define HDR_BRIGHTNESS_UNIT 25.f
+#define HDR_BAND_ROWS 16
+
+struct ShadowMap;
+
+struct HdrSplat {
+    vec2 centre;
+    float radius;
+    LightColor radiance;
+    // scales every pixel by its visibility in the map, which reaches the same radius
+    const ShadowMap *shadow;
+};
+
+// covered pixels x1 to x2 of row y, already clipped to the splat's radius and the buffer. The
+// splat's light is scaled by shade at x1, growing by shadeStep per pixel.
+struct HdrSpan {
+    int16_t x1, x2, y;
+    uint16_t splat;
+    float shade, shadeStep;
+};
+
+struct HdrBuffer {
+    int width, height;
+    std::vector<HdrSplat> splats;
+    // spans per band of HDR_BAND_ROWS rows
+    std::vector<std::vector<HdrSpan>> bands;
+    // accumulated light of the band being resolved
+    std::vector<float> r, g, b;
+};
+
+// starts a frame of the given size without any light
+void hdr_begin(HdrBuffer &hdr, int width, int height);
+// a light's radiance falling off from centre to nothing at radius, in pixels, optionally through
+// the light's shadow map. Returns the splat to fill with it, -1 if the frame can't take more.
+int hdr_add_splat(HdrBuffer &hdr, vec2 centre, float radius, LightColor radiance, const ShadowMap *shadow = nullptr);
+// polygons and triangles cover the pixels whose centres lie inside them, edges they share meet
+// without gaps or overlaps
+void hdr_splat_polygon(HdrBuffer &hdr, int splat, const vec2 *points, int n);
+// fills the triangle a b c with the splat scaled by a shade interpolated between its corners,
+// negative shades take light away
+void hdr_splat_triangle(HdrBuffer &hdr, int splat, vec2 a, vec2 b, vec2 c, float shadeA, float shadeB, float shadeC);
+// fills the whole disc of the splat's radius, for splats with a shadow map
+void hdr_splat_disc(HdrBuffer &hdr, int splat);
+// writes every pixel of fb, which has the size given to hdr_begin, the tonemapped light over
+// the background
+void hdr_resolve(HdrBuffer &hdr, Framebuffer &fb, uint32_t background);
+
+/* -------------------------
+ *       Drawable Stuff
+ * -------------------------
+*/
+
+#define RANDOM_CIRCLE_COUNT 50
+#define RANDOM_CIRCLE_MIN_SIZE 10
+#define RANDOM_CIRCLE_MAX_SIZE 30
+
+extern std::vector<Drawable*> drawables;
+// the same seed always scatters the same circles
+void create_drawables(unsigned int seed);
+void destroy_drawables();
+
+/* -------------------------
+ *       Dynamic Layer
+ * -------------------------
+*/
+
+// Static drawables are baked into the pointmarching cache once. The dynamic ones (players,
+// doors, projectiles) move every frame, so they are kept out of the cache and evaluated
+// exactly at every march step. Their positions are mirrored into packed arrays once per frame
+// by sync(), so the per step query is a short SIMD loop instead of a list of virtual calls.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DYNAMIC_LAYER_SSE2
+#endif
+
+#define DYNAMIC_LANES 4
+#define DYNAMIC_PAD_POS 1e8f
+
+struct DynamicLayer {
+    std::vector<Drawable*> drawables;
+
+    // packed mirrors of the circles and rectangles, padded to a multiple of DYNAMIC_LANES
+    std::vector<float> circleX, circleY, circleR;
+    std::vector<Drawable*> circles;
+    std::vector<float> rectX, rectY, rectHalfW, rectHalfH;
+    std::vector<Drawable*> rects;
+    // anything else falls back to its virtual sdf
+    std::vector<Drawable*> others;
+
+    void add(Drawable *d) {
+        drawables.push_back(d);
+    }
+    void sync();
+    float min_dist(vec2 pos, float min, Drawable **drawable);
+    // lowers min[i] to the distance at pos + (i * step, 0) for n points along a row,
+    // SIMD across the points instead of across the drawables
+    void min_dist_row(vec2 pos, float step, int n, float *min);
+};
+extern DynamicLayer dynamicLayer;
+
+#define DYNAMIC_CIRCLE_COUNT 3
+#define DYNAMIC_CIRCLE_SIZE 15
+#define DYNAMIC_ORBIT_RADIUS 180
+#define DYNAMIC_ORBIT_SPEED 0.5
+
+void create_dynamic_drawables();
+// lets the dynamic circles orbit the middle of the screen
+void move_dynamic_drawables(double time);
+void destroy_dynamic_drawables();
+
+// distance to the static drawables only, this is what gets baked into the cache
+float get_static_min_dist(vec2 pos, Drawable **drawable);
+// exact distance to the whole scene, static and dynamic
+float get_min_dist(vec2 pos, Drawable **drawable);
+float get_min_dist(vec2 pos);
+
+/* -------------------------
+ *        Light Stuff
+ * -------------------------
+*/
+
+#define LIGHT_RAY_MAX_DEPTH 50
+#define EXTRA_LIGHT_MIN_BRIGHTNESS 30
+#define EXTRA_LIGHT_MAX_BRIGHTNESS 100
+// scattered lights get random colours, no channel darker than this
+#define EXTRA_LIGHT_MIN_CHANNEL 0.2f
+// penumbra of the lights in area light mode, roughly their distance to an occluder over their size
+#define LIGHT_AREA_PENUMBRA 8.f
+
+extern std::vector<Light*> lights;
+// the first light is the player's and white, the others are scattered over the world
+void create_lights(int count = 1);
+void destroy_lights();
+#define LIGHT_DIR_COUNT 3600
+extern vec2 light_directions[LIGHT_DIR_COUNT];
+// pre-calculates the evenly spread ray directions every light marches along
+void create_light_directions();
+
+typedef struct RayHitInfo {
+    vec2 pos;
+    Drawable* drawable;
+    float distance;
+    bool hit;
+    // share of an area light that gets past what the ray grazed, from shadeDistance on
+    float shade;
+    float shadeDistance;
+} RayHitInfo;
+
+// rays stop where they leave the bounds, usually the visible part of the world, or after
+// maxDepth world units. With a penumbra k the ray estimates the soft shadow of an area light
+// on the way: the smallest k * d / t where it grazed something, d the clearance at the distance
+// t, is the share of the light that gets past the occluder it grazed most closely.
+bool march_ray(vec2 pos, vec2 delta, RayHitInfo* hit, Bounds bounds, float maxDepth = INFINITY, float threshold = 0.01f, uint16_t maxSteps = 50,
+    float penumbra = 0);
+
+#define PM_CACHE_PRECISION 1
+
+// The world is not bound to the window. The cached field is split into fixed size chunks keyed
+// by chunk coordinate, created on demand and kept in an LRU pool within a memory budget. Each
+// chunk is further split into tiles that are only computed the first time a lookup touches
+// them, so regions no ray ever visits (behind walls, far from any light) are never evaluated.
+#define PM_CHUNK_SIZE 256
+#define PM_TILE_SIZE 16
+#define PM_CHUNK_TILES (PM_CHUNK_SIZE / PM_TILE_SIZE)
+#define PM_CHUNK_TEXELS (PM_CHUNK_SIZE * PM_CHUNK_SIZE)
+// statics further away than this from a chunk are left out of it, its distances are clamped to it
+#define PM_CHUNK_MARGIN 128.f
+#define PM_CHUNK_BUDGET_BYTES (64 << 20)
+
+enum PmTileState : uint8_t {
+    PM_TILE_EMPTY,
+    PM_TILE_BUILDING,
+    PM_TILE_READY
+};
+
+struct PmChunk {
+    int32_t x, y;
+    // the static drawables within reach of this chunk
+    std::vector<Drawable*> statics;
+    std::atomic<uint8_t> tileStates[PM_CHUNK_TILES * PM_CHUNK_TILES];
+    float distances[PM_CHUNK_TEXELS];
+    Drawable *drawables[PM_CHUNK_TEXELS];
+};
+#define PM_CHUNK_BUDGET (PM_CHUNK_BUDGET_BYTES / sizeof(PmChunk))
+
+struct PmChunkSlot {
+    std::shared_ptr<PmChunk> chunk;
+    std::list<uint64_t>::iterator lru;
+};
+
+// one baked version of the static layer, the render loop only ever reads a published one
+struct PmCache {
+    uint64_t generation;
+    // the static drawables this cache was baked from
+    std::vector<Drawable*> statics;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, PmChunkSlot> chunks;
+    // most recently used chunk first
+    std::list<uint64_t> lru;
+    std::atomic<uint32_t> tilesBuilt;
+};
+
+uint64_t get_pm_chunk_key(int32_t x, int32_t y);
+// rounds towards negative infinity, texel and chunk coordinates may be negative
+int32_t floor_div(int64_t a, int32_t b);
+float pm_cache(PmCache &cache, vec2 pos);
+Drawable* pm_d_cache(PmCache &cache, vec2 pos);
+// builds every tile of a chunk ahead of time
+void prefetch_pm_chunk(PmCache &cache, int32_t x, int32_t y);
+// precalculation only drops the chunks, they are filled in by the lookups that need them
+void precalc_pm_cache(PmCache &cache);
+
+/* -------------------------
+ *       Cache Builder
+ * -------------------------
+*/
+
+// The cache is double buffered. A background thread resets the buffer the render loop
+// is not using and publishes it with an atomic pointer swap, so a rebuild never stalls a
+// frame. Until the first cache is published frames march against the exact distances.
+// In between rebuilds the same thread builds the chunks ahead of the player.
+
+#define PM_PREFETCH_DISTANCE 200.f
+#define PM_PREFETCH_QUEUE 32
+
+// called once per frame by the render loop, returns the newest published cache or nullptr
+PmCache* acquire_pm_cache();
+void start_pm_cache_builder();
+// rebakes the static layer from the current drawables, requests while a build is running are coalesced
+void request_pm_cache_rebuild();
+// queues the chunks around a point the player is heading to
+void request_pm_cache_prefetch(vec2 pos);
+void stop_pm_cache_builder();
+
+bool march_ray_cache(PmCache &cache, vec2 pos, vec2 delta, RayHitInfo* hit, Bounds bounds, float maxDepth = INFINITY, float threshold = 0.01f, uint16_t maxSteps = 50,
+    float penumbra = 0);
+vec2 march_ray_light(vec2 pos, vec2 delta, Bounds bounds, float threshold = 0.01f);
+
+struct Polygon {
+    std::vector<int16_t> posX;
+    std::vector<int16_t> posY;
+};
+
+// screen coordinates are clamped so far away lights can't overflow the int16 vertices
+void push_polygon_point(Polygon &polygon, vec2 screen);
+
+// Most hits are collinear (view edge hits, points along one rectangle face). The simplifier
+// merges such runs while the hits stream in, keeping a vertex only where the outline turns by
+// more than the tolerance, in pixels. An optional Douglas-Peucker pass thins the result further.
+#define POLYGON_SIMPLIFY_TOLERANCE 0.5f
+// 0 disables the Douglas-Peucker pass
+#define POLYGON_SIMPLIFY_DP_TOLERANCE 0.f
+
+extern float polygonSimplifyTolerance;
+extern float polygonSimplifyDpTolerance;
+
+float cross(vec2 a, vec2 b);
+// distance of p from the segment a b
+float segment_distance(vec2 p, vec2 a, vec2 b);
+
+struct PolygonSimplifier {
+    // output vertices and a value carried along with each of them
+    std::vector<vec2> points;
+    std::vector<float> values;
+
+    vec2 direction;
+    vec2 candidate;
+    float candidateValue;
+    bool hasCandidate;
+    // the first vertex was kept and must not be merged away when the outline closes
+    bool frontKept;
+
+    void begin() {
+        points.clear();
+        values.clear();
+        hasCandidate = false;
+        frontKept = false;
+    }
+    void emit(vec2 p, float value) {
+        points.push_back(p);
+        values.push_back(value);
+    }
+    // the line from the last kept vertex through the first point after it decides the run,
+    // later points extend the run while they stay within the tolerance of it and move forward
+    void push(vec2 p, float value) {
+        if (polygonSimplifyTolerance <= 0 || points.empty()) {
+            emit(p, value);
+            return;
+        }
+        if (!hasCandidate) {
+            direction = p - points.back();
+            candidate = p;
+            candidateValue = value;
+            hasCandidate = true;
+            return;
+        }
+        float len = direction.magnitude();
+        float dist = len > 0 ? std::abs(cross(direction, p - points.back())) / len : (p - points.back()).magnitude();
+        if (dist <= polygonSimplifyTolerance && (p - candidate) * direction >= 0) {
+            candidate = p;
+            candidateValue = value;
+            return;
+        }
+        emit(candidate, candidateValue);
+        direction = p - candidate;
+        candidate = p;
+        candidateValue = value;
+    }
+    // ends the current run and keeps p as it is, runs after it start from it
+    void keep(vec2 p, float value) {
+        if (hasCandidate)
+            emit(candidate, candidateValue);
+        hasCandidate = false;
+        frontKept |= points.empty();
+        emit(p, value);
+    }
+    void end(bool closed) {
+        if (hasCandidate)
+            emit(candidate, candidateValue);
+        hasCandidate = false;
+        // the start of a closed outline may sit in the middle of a run as well
+        if (closed && points.size() > 3 && polygonSimplifyTolerance > 0 && !frontKept
+            && segment_distance(points.front(), points.back(), points[1]) <= polygonSimplifyTolerance) {
+            points.erase(points.begin());
+            values.erase(values.begin());
+        }
+        if (polygonSimplifyDpTolerance > 0)
+            douglas_peucker();
+    }
+    void douglas_peucker();
+};
+
+// finds the range of light directions whose rays can reach the view, all of them if the
+// light is inside it. Returns false if none do.
+bool visible_directions(vec2 pos, Bounds view, int *first, int *count);
+
+#define LIGHT_FALLOFF_PER_BRIGHTNESS 6.f
+// pixels along a light's radius on screen per ray
+#define LIGHT_RAY_SPACING 1.f
+
+float light_intensity(Light *l, float distance);
+// Level of detail follows what a light contributes. Its intensity fades out at its radius, so
+// its rays stop there, it gets as many directions as its radius is long around on screen, and a
+// light whose radius doesn't reach the view is skipped.
+float light_radius(const Light *l);
+// share of the direction table the light needs at the camera's zoom
+float light_lod_density(const Light *l, const Camera &camera);
+bool light_reaches_view(const Light *l, Bounds view);
+
+// how finely a light is traced in one frame
+struct LightQuality {
+    // share of the light's visible directions that are marched, spread evenly over them
+    float density;
+    uint16_t maxSteps;
+};
+#define LIGHT_FULL_QUALITY LightQuality{ 1, LIGHT_RAY_MAX_DEPTH }
+
+// Marches the directions of a light that reach the camera's view, at its level of detail, up to
+// its radius and leaves its simplified outline, in screen coordinates, in the simplifier.
+// Outlines for a triangle fan around the light skip the tip of a light outside the view and
+// stay open; polygon outlines include it. Returns false if the light doesn't reach the view,
+// closed tells whether the light is surrounded and rays how many were marched.
+bool trace_light(PmCache *cache, Light *l, const Camera &camera, bool fan, PolygonSimplifier &simplifier, bool *closed,
+    LightQuality quality = LIGHT_FULL_QUALITY, int *rays = nullptr);
+
+/* -------------------------
+ *      Quality Governor
+ * -------------------------
+*/
+
+// Holds the march stage to a time budget however many lights there are. The cost of a ray is
+// measured on every traced frame and averaged, the budget divided by it is the number of rays
+// the next frame can afford. They are shared out by priority: every light marches the same
+// share of its directions scaled by its weight, its priority falling off with the distance from
+// the middle of the view, so the player light keeps full quality and far lights thin out first.
+// A light's step cap shrinks along with its share of rays.
+
+// half a frame at 60 frames per second, the other half is left for the fill
+#define QUALITY_BUDGET_MS (1000 / 120.0)
+// no light drops below this share of its directions or this step cap
+#define QUALITY_MIN_DENSITY 0.02f
+#define QUALITY_MIN_STEPS 16
+// weight of the newest frame in the averaged cost per ray
+#define QUALITY_COST_SMOOTHING 0.1
+
+struct QualityGovernor {
+    // switched by the window while the march stage runs
+    std::atomic<bool> enabled { false };
+    double budget { QUALITY_BUDGET_MS };
+    // averaged march time per ray in ms, 0 until the first frame is measured
+    double msPerRay { 0 };
+    // visible directions and weights of the lights being planned
+    std::vector<int> counts;
+    std::vector<float> weights;
+};
+extern QualityGovernor qualityGovernor;
+
+// picks the quality of every light for a frame seen by the camera, full quality while disabled
+void plan_light_quality(QualityGovernor &governor, const Camera &camera, std::vector<LightQuality> &quality);
+// feeds the march time and ray count of a traced frame
+void update_quality_governor(QualityGovernor &governor, double ms, size_t rays);
+
+/* -------------------------
+ *       Shadow Maps
+ * -------------------------
+*/
+
+// Besides its outline every light keeps what its rays found as a 1D shadow map: the distance
+// each ray got before it hit something, indexed by its direction. Whether a point is lit is one
+// lookup at the point's angle around the light, interpolated between the two rays next to it,
+// and the point is lit if it is nearer than that depth. Gameplay can ask any light about any
+// point, and the shaded fill evaluates every light at every pixel without ever scanning an
+// outline. A map only knows what its frame marched: directions that weren't marched and
+// anything beyond where a ray left the view or ran out of steps are dark.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SHADOW_MAP_SSE2
+#endif
+
+struct ShadowMap {
+    const Light *light;
+    vec2 pos;
+    float radius;
+    // the rays are spread evenly over count directions of the table from first on, around the
+    // whole light if closed
+    int first, count;
+    bool closed;
+    // world distance every ray got, in direction order
+    std::vector<float> depths;
+    // only for area lights, the distance from which on the ray is in penumbra and the share of
+    // the light left there
+    std::vector<float> shadeDepths;
+    std::vector<float> shades;
+};
+
+// atan2 to within about 2e-6 radians, the shaded fill uses the same in its SIMD lanes
+float fast_atan2(float y, float x);
+// share of the light that gets to the world position past the occluders, 0 in shadow and 1 in
+// full light, without the falloff
+float shadow_visibility(const ShadowMap &map, vec2 pos);
+// visibility at n pixels along a row, (dx + i, dy) away from the light on a screen with
+// pixelsPerUnit pixels per world unit, SIMD across the pixels
+void shadow_row(const ShadowMap &map, float dx, float dy, int n, float pixelsPerUnit, float *visibility);
+
+/* -------------------------
+ *      Frame Pipeline
+ * -------------------------
+*/
+
+// Marching and filling are two stages. The march stage traces every light into a FrameTrace
+// that owns its outlines, so the fill stage never touches the scene. A worker thread marches
+// frame N+1 from the newest input while the main thread fills and presents frame N, through
+// two trace buffers. The scene may only change while the worker is idle, between
+// wait_frame_trace and submit_frame_trace.
+
+// a ray of an area light that ends in penumbra or next to one that does. The light from inner to
+// outer is scaled by shade, rays joined to the one before span a soft band with it.
+struct PenumbraRay {
+    vec2 inner, outer;
+    float shade;
+    bool joined;
+};
+
+// one light's visible region, in screen coordinates of the frame's camera
+struct LightOutline {
+    std::vector<vec2> points;
+    std::vector<float> values;
+    // only for area lights
+    std::vector<PenumbraRay> penumbra;
+    bool closed;
+    vec2 screenPos;
+    bool inView;
+    // light radius on screen and colour times brightness, for the HDR splat
+    float radius;
+    LightColor radiance;
+    ShadowMap shadow;
+};
+
+struct FrameTrace {
+    Camera camera;
+    // traced as open fans around the lights instead of polygons
+    bool fan;
+    // only the first count outlines belong to this frame, the rest keep their storage
+    std::vector<LightOutline> lights;
+    size_t count;
+    // per light in lights, as planned by the quality governor
+    std::vector<LightQuality> quality;
+    size_t rays;
+    double marchMs;
+};
+
+void trace_frame(FrameTrace &frame, PmCache *cache, const Camera &camera, bool fan);
+// adds up the visible regions of all lights in an HDR buffer, tonemaps it over the background
+// into the whole framebuffer and marks the lights in view. The outlines are scaled by scale, for
+// a framebuffer smaller than the window.
+void fill_frame(Framebuffer &fb, const FrameTrace &frame, float scale = 1);
+// the same picture from the shadow maps, every light is evaluated at every pixel it reaches
+void shade_frame(Framebuffer &fb, const FrameTrace &frame, float scale = 1);
+// the map of a light in the frame, nullptr if it didn't reach the view
+const ShadowMap* find_shadow_map(const FrameTrace &frame, const Light *l);
+
+struct FramePipeline {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    FrameTrace frames[2];
+    // the buffer the worker traces into next
+    int back { 0 };
+    bool submitted { false };
+    bool pending { false };
+    bool busy { false };
+    bool quit { false };
+    PmCache *cache;
+    Camera camera;
+    bool fan;
+};
+extern FramePipeline framePipeline;
+
+void start_frame_pipeline();
+// starts marching a frame of the scene as it is now in the background, the scene must not
+// change until the matching wait_frame_trace
+void submit_frame_trace(PmCache *cache, const Camera &camera, bool fan);
+// waits for the submitted frame, it stays valid until the second submit after this.
+// Returns nullptr if nothing was submitted.
+FrameTrace* wait_frame_trace();
+void stop_frame_pipeline();
+
+/* -------------------------
+ *    Visibility Engines
+ * -------------------------
+*/
+
+// Two ways to find how far every ray of a light gets. The march engine sphere traces each ray
+// through the distance field, a few large steps where the scene is open. The polar engine
+// doesn't march: it resamples the cached field into polar coordinates around the light, one ring
+// of a work item's directions after the other outwards, and reduces every direction's column to
+// its first occluded sample, a running min over the rings. Its accesses are regular and its
+// cost is the area the light covers, however many steps a ray would have taken. It grazes and
+// hits the same surfaces as the march engine, only the step cap of the quality governor has
+// nothing to cap. Without a published cache the polar engine marches as well.
+
+enum VisibilityEngine {
+    VISIBILITY_MARCH,
+    VISIBILITY_POLAR
+};
+// switched by the window while the march stage runs, every frame is traced by one engine
+extern std::atomic<VisibilityEngine> visibilityEngine;
+
+// world distance between the rings, one cache texel
+#define POLAR_RING_STEP (1.f / PM_CACHE_PRECISION)
+
+struct LightJob;
+// fills the job's output for its rays begin to end like the march engine, from the rings
+void polar_light_rays(LightJob &job, PmCache &cache, const Camera &camera, int begin, int end);
+
+/* -------------------------
+ *        Light Queue
+ * -------------------------
+*/
+
+// Marches all lights of a frame in one parallel pass instead of one light after the other. The
+// rays of every light are cut into work items of LIGHT_QUEUE_CHUNK consecutive directions and
+// the items of all lights are dealt out round robin to one queue per worker, so every worker
+// starts with a mix of cheap and expensive lights. A worker takes items from its own queue and,
+// once that runs dry, steals from the others, which keeps the cores busy when the lights cost
+// very different amounts. Hits land in the light's own slice of the output, the worker that
+// finishes a light's last item simplifies its outline and copies its shadow map into the frame.
+
+#define LIGHT_QUEUE_CHUNK 64
+#define LIGHT_QUEUE_MAX_THREADS 16
+
+// one light's share of a frame, set up before any of its rays are marched
+struct LightJob {
+    Light *light;
+    LightQuality quality;
+    int first, count, marched;
+    float radius;
+    bool closed;
+    // slot of the light in the frame's outlines
+    size_t outline;
+    // screen position and intensity of every marched ray, in direction order
+    std::vector<vec2> points;
+    std::vector<float> values;
+    // screen position from which on the ray is in penumbra and the share of the light left there
+    std::vector<vec2> inner;
+    std::vector<float> shades;
+    // the same in world distances along the ray, for the shadow map
+    std::vector<float> depths;
+    std::vector<float> shadeDepths;
+    // items still being marched, the worker that takes this to 0 builds the outline
+    std::atomic<int> remaining;
+};
+
+// consecutive rays of one light
+struct LightWork {
+    int job;
+    int begin, end;
+};
+
+struct LightWorkQueue {
+    std::vector<LightWork> items;
+    // the owner and thieves all claim items from here
+    std::atomic<int> next { 0 };
+};
+
+struct LightQueue {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    // bumped for every frame, workers join each frame once
+    uint64_t pass { 0 };
+    int working { 0 };
+    bool quit { false };
+    // the calling thread works queue 0, the threads the ones after it
+    LightWorkQueue queues[LIGHT_QUEUE_MAX_THREADS + 1];
+    // keep their storage between frames, only the first jobCount belong to the frame
+    std::deque<LightJob> jobs;
+    size_t jobCount { 0 };
+    PmCache *cache;
+    Camera camera;
+    bool fan;
+    VisibilityEngine engine;
+    FrameTrace *frame;
+};
+extern LightQueue lightQueue;
+
+// threads are the workers besides the calling thread, 0 picks one less than the hardware threads
+void start_light_queue(int threads = 0);
+// marches the lights of the frame at their planned quality and leaves their outlines in it.
+// Without started workers the calling thread takes every item itself.
+void march_lights(FrameTrace &frame, PmCache *cache, const Camera &camera, bool fan);
+void stop_light_queue();
+
+/* -------------------------
+ *    Resolution Governor
+ * -------------------------
+*/
+
+// Holds a frame time budget by filling the lights at a lower resolution, the window stretches
+// the smaller image over itself. The frame times are averaged over a rolling window. Over the
+// budget the scale drops right away to where the fill is expected to fit, assuming its cost
+// follows the pixel count. It only rises again a step at a time and only when the average,
+// grown by the pixels of the next step, stays well under the budget, and every change starts a
+// new window, so it settles instead of oscillating around the budget.
+
+#define RESOLUTION_BUDGET_MS (1000 / 60.0)
+#define RESOLUTION_WINDOW 30
+#define RESOLUTION_MIN_SCALE 0.25f
+#define RESOLUTION_SCALE_STEP 0.125f
+// share of the budget the expected average one step up has to stay under to scale up
+#define RESOLUTION_UP_THRESHOLD 0.7
+
+struct ResolutionGovernor {
+    double budget { RESOLUTION_BUDGET_MS };
+    float scale { 1 };
+    // frame times in ms, a ring buffer holding count of them
+    double times[RESOLUTION_WINDOW];
+    int count { 0 };
+    int next { 0 };
+    double sum { 0 };
+};
+extern ResolutionGovernor resolutionGovernor;
+
+// feeds the time of the last frame, returns true if the scale changed
+bool update_resolution_governor(ResolutionGovernor &governor, double frameMs);
+// drops the window and goes back to full resolution
+void reset_resolution_governor(ResolutionGovernor &governor);
+// the size of the framebuffer at the governor's scale
+int scaled_size(int size, float scale);
+
+/* -------------------------
+ *        Field View
+ * -------------------------
+*/
+
+// Shows the distance field itself instead of the lights, to check the cache against the
+// exact field. The view is split into tiles that a pool of workers and the calling thread take
+// from a shared counter. Each tile is evaluated a row at a time, several pixels per SIMD step,
+// and written colour mapped into the framebuffer, so a frame is still a single upload.
+
+#define FIELD_VIEW_TILE_SIZE 32
+#define FIELD_VIEW_MAX_THREADS 16
+// distance in world units at which the colour map saturates
+#define FIELD_VIEW_RANGE 150.f
+// world units between two iso lines
+#define FIELD_VIEW_ISO_SPACING 10.f
+// difference between cache and exact field in world units that shows as full red
+#define FIELD_VIEW_ERROR_RANGE 1.f
+
+enum FieldSource {
+    FIELD_SOURCE_CACHE,
+    FIELD_SOURCE_EXACT,
+    // absolute difference of the cached and the exact static field
+    FIELD_SOURCE_ERROR
+};
+
+struct FieldView {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    // bumped for every frame, workers join each frame once
+    uint64_t job { 0 };
+    int working { 0 };
+    bool quit { false };
+    std::atomic<int> nextTile { 0 };
+    int tilesX, tileCount;
+    // the static drawables in the same packed layout as the dynamic ones
+    DynamicLayer statics;
+    Framebuffer *fb;
+    PmCache *cache;
+    Camera camera;
+    // framebuffer pixels per window pixel
+    float scale;
+    FieldSource source;
+};
+extern FieldView fieldView;
+
+// threads are the workers besides the calling thread, 0 picks one less than the hardware threads
+void start_field_view(int threads = 0);
+// draws the field of the scene as seen by the camera over the whole framebuffer, which covers
+// the window at the given scale. Without a published cache the cached sources fall back to the
+// exact field.
+void draw_field(Framebuffer &fb, PmCache *cache, const Camera &camera, FieldSource source, float scale = 1);
+void stop_field_view();
+
+#endif